@@ -5,21 +5,131 @@
 #include <thread>
 #include <chrono>
 #include <mutex>
+#include <atomic>
+#include <condition_variable>
 #include <map>
 #include <string>
 #include <fstream>
 #include <iomanip>
+#include <memory>
+#include <tuple>
+#include <cmath>
+#include <algorithm>
+#include <deque>
+#include <future>
+#include <set>
+#include <sstream>
+#include <csignal>
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+#include "metrics_shm.h"
+#include "metrics_snapshot.h"
+#include "structured_output.h"
+#include "tsdb.h"
+#include "fps_estimators.h"
+#include "stall_watchdog.h"
+#include "rtp_stats.h"
+#include "frozen_detector.h"
+#include "decode_pool.h"
+#include "mosaic.h"
+#include "duplicate_detector.h"
+#include "clip_recorder.h"
+#include "snapshot_server.h"
+#include "relay_server.h"
+#include "control_server.h"
+#include "dashboard.h"
 // Global mutex for synchronizing FPS updates and console output
 std::mutex fps_mutex;
-// Global map to store FPS for each camera
-std::map<std::string, int> fps_map;
+// Global map to store the latest FPS, bitrate and jitter for each camera
+std::map<std::string, CameraSample> fps_map;
 std::map<std::string, int> downtime_map; // Track downtime in seconds for each camera
+// Shared-memory segment for local readers, only opened with --shm
+metrics_shm::Writer metrics_segment;
+// JSON Lines / CSV writers fed from print_fps, each with its own thread
+std::vector<std::unique_ptr<StructuredWriter>> structured_writers;
+bool console_output = true; // Disabled when structured output goes to stdout
+Estimator console_estimator = Estimator::Tumbling;
+int console_precision = 0; // Whole FPS unless the interval or estimator gives fractions
+// Multi-resolution rollups per camera, guarded by fps_mutex
+std::map<std::string, RollupSeries> rollup_map;
+std::vector<RollupRecord> closed_rollups; // Drained by print_fps every tick
+bool emit_rollups = false;
+// Last-frame-age watchdog, only running with --stall-timeout
+std::unique_ptr<StallWatchdog> stall_watchdog;
+int64_t stall_timeout_ns = 0;
+constexpr int64_t kReconnectBackoffNs = 5000000000LL; // Minimum time between reconnects of one camera
+// Caps and parameter set changes not yet handed to the outputs, guarded by fps_mutex
+std::vector<StreamEvent> stream_events;
+// Shared keyframe decoders, only running with --decode-every
+std::unique_ptr<DecodePool> decode_pool;
+int64_t decode_every_ns = 0;
+size_t decode_workers = 2;
+// Full-screen table instead of the console line, only with --dashboard
+std::unique_ptr<Dashboard> dashboard;
+// Thumbnail mosaic of all cameras, only with --mosaic
+std::unique_ptr<MosaicWriter> mosaic_writer;
+// Cameras that reuse another camera's session for an identical URI, with
+// --share-identical; fixed before the threads start
+std::map<std::string, std::string> shared_sessions;
+// Groups of cameras with identical streams, print thread only
+std::vector<std::vector<std::string>> duplicate_groups;
+// Pre-event clips, only with --clip-dir
+std::unique_ptr<ClipArena> clip_arena;
+std::unique_ptr<ClipWriter> clip_writer;
+int64_t clip_window_ns = 10000000000LL;
+constexpr int64_t kClipCooldownNs = 60000000000LL; // Minimum time between clips of one camera
+#ifdef HAVE_RTSP_SERVER
+// Re-serves every camera over RTSP, only with --relay
+std::unique_ptr<RelayServer> relay_server;
+#endif
+// On-disk metrics history, only opened with --tsdb
+std::unique_ptr<tsdb::Store> metrics_store;
+// Written by SIGINT/SIGTERM and the dashboard's quit key; main() waits on it
+int shutdown_fd = -1;
+std::atomic<int> shutdown_signals{0};
+// Stops print_fps at shutdown
+std::mutex print_mutex;
+std::condition_variable print_wake;
+bool print_stopping = false;
+
+void request_shutdown() {
+    uint64_t one = 1;
+    ssize_t written = ::write(shutdown_fd, &one, sizeof(one));
+    (void)written;
+}
+
+// Async-signal-safe; a second signal gives up on the orderly shutdown
+void on_shutdown_signal(int sig) {
+    if (shutdown_signals.fetch_add(1) > 0) {
+        Dashboard::restore_terminal();
+        ::signal(sig, SIG_DFL);
+        ::raise(sig);
+        return;
+    }
+    request_shutdown();
+}
 
 class Camera {
 public:
-    Camera(const std::string& name, const std::string& uri) : name(name), uri(uri), frame_count(0), running(true) {
+    Camera(const std::string& name, const std::string& uri, std::chrono::milliseconds interval)
+        : name(name), uri(uri), frame_count(0), running(true),
+          estimators(std::chrono::duration_cast<std::chrono::nanoseconds>(interval).count()) {
         std::cout << "Initializing camera with URI: " << uri << std::endl;
-        downtime_map[name] = -1;
+        {
+            // Cameras added through the control socket race with running ones
+            std::lock_guard<std::mutex> fps_lock(fps_mutex);
+            downtime_map[name] = -1;
+        }
+        shm_slot = metrics_segment.add_camera(name);
+        if (clip_arena) {
+            clip_ring = std::make_unique<ClipRing>(*clip_arena, clip_window_ns);
+        }
+#ifdef HAVE_RTSP_SERVER
+        if (relay_server) {
+            relay_mount = std::make_shared<RelayMount>("/" + name);
+        }
+#endif
         pipeline = gst_pipeline_new("pipeline");
         appsink = gst_element_factory_make("appsink", "sink");
         source = gst_element_factory_make("rtspsrc", "source");
@@ -45,17 +155,49 @@ public:
         // Link parsebin to appsink
         g_signal_connect(parsebin, "pad-added", G_CALLBACK(&Camera::on_parsebin_pad_added), this);
 
+        // Watch RTP sequence numbers as they enter each jitterbuffer, before reordering
+        g_signal_connect(source, "new-manager", G_CALLBACK(&Camera::on_new_manager), this);
+
+        if (stall_watchdog) {
+            watch.name = name;
+            watch.timeout_ns = stall_timeout_ns;
+            watch.armed_ns = steady_now_ns();
+            watch.on_stall = [this](int64_t age_ns) { on_stall(age_ns); };
+            watch.on_recover = [this]() {
+                stall_reported = false;
+                std::cout << "Stream recovered: " << this->name << std::endl;
+            };
+            stall_watchdog->add(&watch);
+        }
+
         std::cout << "Camera initialized successfully." << std::endl;
     }
 
     ~Camera() {
         std::cout << "Cleaning up camera for URI: " << uri << std::endl;
+        if (stall_watchdog) {
+            stall_watchdog->remove(&watch);
+        }
         gst_element_set_state(pipeline, GST_STATE_NULL);
         gst_object_unref(GST_OBJECT(pipeline));
+#ifdef HAVE_RTSP_SERVER
+        if (relay_mount) {
+            relay_server->unmount(*relay_mount);
+        }
+#endif
+        for (GstBuffer* buffer : {latest_keyframe, latest_config}) {
+            if (buffer) {
+                gst_buffer_unref(buffer);
+            }
+        }
+        if (latest_keyframe_caps) {
+            gst_caps_unref(latest_keyframe_caps);
+        }
     }
 
     void start() {
         std::cout << "Starting camera: " << uri << std::endl;
+        watch.armed_ns = steady_now_ns();  // Give the new session one timeout to deliver a frame
         if (gst_element_set_state(pipeline, GST_STATE_PLAYING) == GST_STATE_CHANGE_FAILURE) {
             std::cerr << "Failed to start pipeline for camera: " << uri << std::endl;
         } else {
@@ -72,30 +214,243 @@ public:
         }
     }
 
-    void run(int interval) {
+    void run(std::chrono::milliseconds interval) {
+        double seconds = interval.count() / 1000.0;
+        // Reconnect after 5 empty intervals, but never sooner than 5 seconds
+        int reconnect_after = std::max<int>(5, (5000 + interval.count() - 1) / interval.count());
+        auto deadline = std::chrono::steady_clock::now() + interval;
+        current_interval_ms = interval.count();
         while (running) {
-            std::this_thread::sleep_for(std::chrono::seconds(interval));  // Check FPS every 'interval' seconds
-            std::lock_guard<std::mutex> lock(mutex);
-            int fps = frame_count / interval;
-            frame_count = 0;  // Reset frame count after printing
+            // A new interval from the control socket applies from the last tick on
+            if (int64_t requested = requested_interval_ms.exchange(0); requested > 0) {
+                deadline += std::chrono::milliseconds(requested) - interval;
+                interval = std::chrono::milliseconds(requested);
+                seconds = interval.count() / 1000.0;
+                reconnect_after = std::max<int>(5, (5000 + interval.count() - 1) / interval.count());
+                current_interval_ms = interval.count();
+                estimators.reset(std::chrono::duration_cast<std::chrono::nanoseconds>(interval).count());
+                std::lock_guard<std::mutex> fps_lock(fps_mutex);
+                if (rollup_slot) {
+                    rollup_slot->set_interval(interval.count());
+                }
+            }
+            // Wait for an absolute deadline so ticks do not drift at sub-second
+            // intervals; the stall watchdog can wake us earlier to reconnect
+            {
+                std::unique_lock<std::mutex> wake_lock(wake_mutex);
+                if (wake.wait_until(wake_lock, deadline, [this] {
+                        return reconnect_requested || !running || requested_interval_ms != 0;
+                    })) {
+                    wake_lock.unlock();
+                    if (running && reconnect_requested.exchange(false)) {
+                        reconnect();
+                    }
+                    continue;
+                }
+            }
+            deadline += interval;
+            // Only the counter harvest holds the camera mutex; the streaming
+            // thread takes it on every frame
+            double fps;
+            uint64_t interval_bytes;
+            double bitrate_kbps;
+            double jitter_ms = 0.0;
+            bool stalled;
+            StreamInfo stream;
+            uint32_t interval_caps_changes;
+            uint32_t interval_parameter_set_changes;
+            std::vector<uint32_t> recent_keyframes;
+            FrameTypeCounts interval_frame_types;
+            std::vector<StreamEvent> events;
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                fps = frame_count / seconds;
+                interval_bytes = byte_count;
+                bitrate_kbps = byte_count * 8.0 / 1000.0 / seconds;
+                if (gap_count > 1) {
+                    double mean = gap_sum_ms / gap_count;
+                    jitter_ms = std::sqrt(std::max(0.0, gap_sq_sum_ms / gap_count - mean * mean));
+                }
+                stalled = frame_count == 0;
+                stream = stream_info;
+                interval_caps_changes = caps_changes;
+                interval_parameter_set_changes = parameter_set_changes;
+                recent_keyframes.assign(keyframe_hashes.begin(), keyframe_hashes.end());
+                interval_frame_types = frame_types;
+                frame_types = FrameTypeCounts();
+                caps_changes = 0;
+                parameter_set_changes = 0;
+                events.swap(pending_events);
+                frames_total += frame_count;
+                frame_count = 0;  // Reset frame count after printing
+                byte_count = 0;
+                gap_count = 0;
+                gap_sum_ms = 0.0;
+                gap_sq_sum_ms = 0.0;
+            }
+            bool frozen = frozen_detector.frozen();
+            if (frozen != frozen_reported) {
+                std::cout << (frozen ? "Frozen image detected: " : "Image moving again: ") << name << std::endl;
+                frozen_reported = frozen;
+            }
+            if (clip_ring) {
+                maybe_dump_clip(stalled ? "stalled" : frozen ? "frozen" : fps < 5 ? "low_fps" : "");
+            }
+            int relay_clients = 0;
+            double relay_egress_kbps = 0.0;
+#ifdef HAVE_RTSP_SERVER
+            if (relay_mount) {
+                relay_clients = relay_mount->clients();
+                relay_egress_kbps = relay_mount->take_egress_bytes() * 8.0 / 1000.0 / seconds;
+            }
+#endif
+            int64_t last_frame_ns = watch.last_frame_ns.load(std::memory_order_relaxed);
+
+            int64_t steady_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now().time_since_epoch()).count();
+            double fps_sliding = estimators.sliding_fps(steady_ns);
+            double fps_ewma = estimators.ewma_fps(steady_ns);
+            int64_t now_ms = std::chrono::duration_cast<std::chrono::milliseconds>(
+                std::chrono::system_clock::now().time_since_epoch()).count();
+
+            RtpIntervalStats rtp;
+            double drift_ppm = NAN;
+            std::vector<double> latencies;
+            {
+                std::lock_guard<std::mutex> rtp_lock(rtp_mutex);
+                // Clock figures come from the busiest stream, normally the video track
+                uint64_t busiest = 0;
+                for (auto stream = rtp_streams.begin(); stream != rtp_streams.end();) {
+                    RtpIntervalStats stats = stream->second.sequence.take_interval();
+                    std::vector<double> stream_latencies = stream->second.clock.take_latencies();
+                    rtp.merge(stats);
+                    if (stats.received >= busiest) {
+                        busiest = stats.received;
+                        drift_ppm = stream->second.clock.drift_ppm();
+                        latencies.swap(stream_latencies);
+                    }
+                    // A new SSRC per reconnect would otherwise grow the map forever
+                    stream->second.idle_intervals = stats.received ? 0 : stream->second.idle_intervals + 1;
+                    if (stream->second.idle_intervals >= RtpStreamStats::kMaxIdleIntervals) {
+                        stream = rtp_streams.erase(stream);
+                    } else {
+                        ++stream;
+                    }
+                }
+            }
+            ImageQuality image;
+            SceneState scene;
+            DecodedFramePtr frame;
+            {
+                std::lock_guard<std::mutex> decoded_lock(decoded_mutex);
+                image = image_quality;
+                scene = scene_state;
+                frame = last_decoded;
+            }
+
+            std::vector<TrackSample> track_samples;
+            {
+                std::lock_guard<std::mutex> tracks_lock(tracks_mutex);
+                for (auto& track : tracks) {
+                    uint64_t packets = track->packets.exchange(0, std::memory_order_relaxed);
+                    uint64_t frames = track->frames.exchange(0, std::memory_order_relaxed);
+                    uint64_t bytes = track->bytes.exchange(0, std::memory_order_relaxed);
+                    int64_t last_packet_ns = track->last_packet_ns.load(std::memory_order_relaxed);
+                    TrackSample sample;
+                    sample.track = track->name;
+                    sample.media = track->media;
+                    sample.encoding = track->encoding;
+                    // Audio packets carry no frame boundary worth counting, the marker only flags talkspurts
+                    sample.rate = (track->media == "audio" ? packets : frames) / seconds;
+                    sample.packet_rate = packets / seconds;
+                    sample.bitrate_kbps = bytes * 8.0 / 1000.0 / seconds;
+                    sample.age_ms = last_packet_ns ? (steady_ns - last_packet_ns) / 1e6 : -1.0;
+                    track_samples.push_back(sample);
+                }
+            }
+
+            double latency_p50_ms = percentile(latencies, 0.50);
+            double latency_p95_ms = percentile(latencies, 0.95);
+            double latency_p99_ms = percentile(latencies, 0.99);
 
-            // Update the global FPS map
+            metrics_shm::CameraMetrics metrics{};
+            bool reconnect = false;
+            // Update the global FPS map; keep the critical section to plain stores
             {
                 std::lock_guard<std::mutex> fps_lock(fps_mutex);
-                fps_map[name] = fps;
-
-                // Check for downtime and handle reconnect if necessary
-                if (fps == 0) {
-                    downtime_map[name] += 1;
-                    if (downtime_map[name] >= 5) {  // Reconnect if downtime is >= 5*interval seconds
-                        std::cout << "Reconnecting camera: " << name << std::endl;
-                        stop();
-                        start();
-                        downtime_map[name] = 0;  // Reset downtime counter after reconnect
+                if (!sample_slot) {
+                    // std::map nodes are stable, so look the entries up only once
+                    sample_slot = &fps_map[name];
+                    downtime_slot = &downtime_map[name];
+                    rollup_slot = &rollup_map.try_emplace(name, name, interval.count()).first->second;
+                    sample_slot->name = name;
+                }
+                CameraSample& sample = *sample_slot;
+                sample.fps = fps;
+                sample.bitrate_kbps = bitrate_kbps;
+                sample.relay_clients = relay_clients;
+                sample.relay_egress_kbps = relay_egress_kbps;
+                sample.jitter_ms = jitter_ms;
+                sample.fps_sliding = fps_sliding;
+                sample.fps_ewma = fps_ewma;
+                sample.stalled = stall_watchdog ? watch.stalled.load(std::memory_order_relaxed) : stalled;
+                sample.frame_age_ms = last_frame_ns ? (steady_ns - last_frame_ns) / 1e6 : -1.0;
+                sample.rtp = rtp;
+                sample.drift_ppm = drift_ppm;
+                sample.latency_p50_ms = latency_p50_ms;
+                sample.latency_p95_ms = latency_p95_ms;
+                sample.latency_p99_ms = latency_p99_ms;
+                sample.stream = stream;
+                sample.frozen = frozen;
+                sample.frame_types = interval_frame_types;
+                sample.image = image;
+                sample.scene = scene;
+                sample.keyframe_hashes.swap(recent_keyframes);
+                sample.frame = frame;
+                sample.caps_changes = interval_caps_changes;
+                sample.parameter_set_changes = interval_parameter_set_changes;
+                sample.tracks.swap(track_samples);
+                stream_events.insert(stream_events.end(), events.begin(), events.end());
+                rollup_slot->add_sample(now_ms, interval.count(), fps, interval_bytes, closed_rollups);
+
+                // Check for downtime and handle reconnect if necessary; with the
+                // stall watchdog enabled it owns reconnects instead
+                int& downtime = *downtime_slot;
+                if (stalled) {
+                    downtime += 1;
+                    if (!stall_watchdog && downtime >= reconnect_after) {
+                        reconnect = true;
+                        downtime = 0;  // Reset downtime counter after reconnect
                     }
                 } else {
-                    downtime_map[name] = 0;  // Reset downtime counter if FPS > 0
+                    downtime = 0;  // Reset downtime counter if FPS > 0
                 }
+                metrics.downtime = downtime;
+                sample.downtime = downtime;
+            }
+
+            // Restart outside both mutexes so a slow teardown never stalls this
+            // camera's streaming thread or the other cameras
+            if (reconnect) {
+                this->reconnect();
+            }
+
+            // Publish outside the locks; readers never block us
+            if (shm_slot >= 0) {
+                std::strncpy(metrics.name, name.c_str(), metrics_shm::kNameSize - 1);
+                metrics.updated_ns = metrics_shm::realtime_ns();
+                metrics.fps = static_cast<float>(fps);
+                metrics.frames_total = frames_total;
+                metrics.reconnects = reconnects;
+                metrics.bitrate_kbps = static_cast<uint32_t>(bitrate_kbps);
+                metrics.jitter_ms = static_cast<float>(jitter_ms);
+                metrics.loss_pct = static_cast<float>(rtp.loss_pct());
+                metrics.packets_lost = static_cast<uint32_t>(rtp.lost);
+                metrics.drift_ppm = static_cast<float>(drift_ppm);
+                metrics.latency_p50_ms = static_cast<float>(latency_p50_ms);
+                metrics.width = static_cast<uint16_t>(stream.width);
+                metrics.height = static_cast<uint16_t>(stream.height);
+                metrics_segment.publish(shm_slot, metrics);
             }
         }
     }
@@ -106,24 +461,128 @@ public:
         GstCaps* caps = gst_pad_query_caps(pad, NULL);
         GstStructure* s = gst_caps_get_structure(caps, 0);
         const gchar* encoding_name = gst_structure_get_string(s, "encoding-name");
+        const gchar* media = gst_structure_get_string(s, "media");
 
         if (encoding_name) {
             std::cout << "ENCODING NAME: " << encoding_name << std::endl;
         } else {
             std::cout << "Failed to get encoding-name." << std::endl;
+            gst_caps_unref(caps);
             return; // Exit if encoding-name is not found
         }
+        std::string encoding = encoding_name;
+        std::string media_type = media ? media : "unknown";
+        gst_caps_unref(caps);
 
-        GstPad* sink_pad = gst_element_get_static_pad(camera->parsebin, "sink");
+        // Pads are named recv_rtp_src_<stream>_<ssrc>_<pt>; only the stream index survives a reconnect
+        guint stream = 0;
+        gchar* pad_name = gst_pad_get_name(pad);
+        std::sscanf(pad_name, "recv_rtp_src_%u", &stream);
+        g_free(pad_name);
+
+        Track* track = camera->add_track(stream, media_type, encoding);
+        gst_pad_add_probe(pad, GstPadProbeType(GST_PAD_PROBE_TYPE_BUFFER | GST_PAD_PROBE_TYPE_BUFFER_LIST),
+                          &Camera::on_track_probe, track, NULL);
+
+        // The first video stream feeds parsebin and the FPS counters, every other
+        // stream ends in its own fakesink and is only counted by the probe
+        GstPad* sink_pad = nullptr;
+        if (track->primary) {
+            sink_pad = gst_element_get_static_pad(camera->parsebin, "sink");
+        } else {
+            if (!track->sink) {
+                track->sink = gst_element_factory_make("fakesink", NULL);
+                if (!track->sink) {
+                    std::cerr << "Failed to create fakesink for " << track->name << " of camera: " << camera->uri << std::endl;
+                    return;
+                }
+                g_object_set(track->sink, "sync", FALSE, "async", FALSE, NULL);
+                gst_bin_add(GST_BIN(camera->pipeline), track->sink);
+                gst_element_sync_state_with_parent(track->sink);
+            }
+            sink_pad = gst_element_get_static_pad(track->sink, "sink");
+        }
         if (gst_pad_link(pad, sink_pad) != GST_PAD_LINK_OK) {
-            std::cerr << "Failed to link pad from rtspsrc to parsebin!" << std::endl;
+            std::cerr << "Failed to link pad from rtspsrc for " << track->name << " of camera: " << camera->uri << std::endl;
         }
         gst_object_unref(sink_pad);
     }
 
+    // Counters of one RTSP media stream, updated without locks from its streaming thread
+    struct Track {
+        guint stream;
+        std::string name;
+        std::string media;
+        std::string encoding;
+        bool primary;
+        GstElement* sink = nullptr;  // fakesink for streams other than the primary video
+        std::atomic<uint64_t> packets{0};
+        std::atomic<uint64_t> frames{0};  // RTP packets with the marker bit set
+        std::atomic<uint64_t> bytes{0};
+        std::atomic<int64_t> last_packet_ns{0};
+
+        void count(GstBuffer* buffer) {
+            guint8 header[2];
+            if (gst_buffer_extract(buffer, 0, header, sizeof(header)) != sizeof(header)) {
+                return;
+            }
+            packets.fetch_add(1, std::memory_order_relaxed);
+            bytes.fetch_add(gst_buffer_get_size(buffer), std::memory_order_relaxed);
+            if (header[1] & 0x80) {
+                frames.fetch_add(1, std::memory_order_relaxed);
+            }
+            last_packet_ns.store(steady_now_ns(), std::memory_order_relaxed);
+        }
+    };
+
+    // Returns the track of an RTSP stream index, reusing it after a reconnect
+    Track* add_track(guint stream, const std::string& media, const std::string& encoding) {
+        std::lock_guard<std::mutex> lock(tracks_mutex);
+        bool has_primary = false;
+        for (auto& track : tracks) {
+            if (track->stream == stream) {
+                track->encoding = encoding;
+                return track.get();
+            }
+            has_primary = has_primary || track->primary;
+        }
+        auto track = std::make_unique<Track>();
+        track->stream = stream;
+        track->name = media + std::to_string(stream);
+        track->media = media;
+        track->encoding = encoding;
+        track->primary = media == "video" && !has_primary;
+        std::cout << "Track " << track->name << " (" << encoding << ") for camera: " << name
+                  << (track->primary ? ", counted for FPS" : "") << std::endl;
+        tracks.push_back(std::move(track));
+        return tracks.back().get();
+    }
+
+    static GstPadProbeReturn on_track_probe(GstPad* pad, GstPadProbeInfo* info, gpointer user_data) {
+        Track* track = static_cast<Track*>(user_data);
+        if (GST_PAD_PROBE_INFO_TYPE(info) & GST_PAD_PROBE_TYPE_BUFFER_LIST) {
+            GstBufferList* list = GST_PAD_PROBE_INFO_BUFFER_LIST(info);
+            guint length = gst_buffer_list_length(list);
+            for (guint i = 0; i < length; ++i) {
+                track->count(gst_buffer_list_get(list, i));
+            }
+        } else {
+            track->count(GST_PAD_PROBE_INFO_BUFFER(info));
+        }
+        return GST_PAD_PROBE_OK;
+    }
+
     static void on_parsebin_pad_added(GstElement* parsebin, GstPad* pad, Camera* camera) {
         std::cout << "Pad added for parsebin for camera: " << camera->uri << std::endl;
 
+        // Record the negotiated format now and again on every renegotiation
+        GstCaps* caps = gst_pad_get_current_caps(pad);
+        if (caps) {
+            camera->update_stream_info(caps);
+            gst_caps_unref(caps);
+        }
+        gst_pad_add_probe(pad, GST_PAD_PROBE_TYPE_EVENT_DOWNSTREAM, &Camera::on_parsed_event, camera, NULL);
+
         // Link to appsink
         GstPad* sink_pad = gst_element_get_static_pad(camera->appsink, "sink");
         if (gst_pad_link(pad, sink_pad) != GST_PAD_LINK_OK) {
@@ -135,11 +594,258 @@ public:
         gst_object_unref(sink_pad);
     }
 
+    static GstPadProbeReturn on_parsed_event(GstPad* pad, GstPadProbeInfo* info, gpointer user_data) {
+        GstEvent* event = GST_PAD_PROBE_INFO_EVENT(info);
+        if (GST_EVENT_TYPE(event) == GST_EVENT_CAPS) {
+            GstCaps* caps = nullptr;
+            gst_event_parse_caps(event, &caps);  // Borrowed from the event
+            if (caps) {
+                static_cast<Camera*>(user_data)->update_stream_info(caps);
+            }
+        }
+        return GST_PAD_PROBE_OK;
+    }
+
+    void update_stream_info(GstCaps* caps) {
+        if (gst_caps_get_size(caps) == 0) {
+            return;
+        }
+        GstStructure* s = gst_caps_get_structure(caps, 0);
+        StreamInfo info;
+        std::string media = gst_structure_get_name(s);
+        gint mpegversion = 0;
+        if (media == "video/x-h264") {
+            info.codec = "H264";
+        } else if (media == "video/x-h265") {
+            info.codec = "H265";
+        } else if (media == "image/jpeg") {
+            info.codec = "MJPEG";
+        } else if (media == "video/mpeg" && gst_structure_get_int(s, "mpegversion", &mpegversion) && mpegversion == 4) {
+            info.codec = "MPEG4";
+        } else {
+            info.codec = media;
+        }
+        if (const gchar* value = gst_structure_get_string(s, "profile")) {
+            info.profile = value;
+        }
+        if (const gchar* value = gst_structure_get_string(s, "level")) {
+            info.level = value;
+        }
+        if (const gchar* value = gst_structure_get_string(s, "stream-format")) {
+            info.stream_format = value;
+        }
+        // In-band parameter sets are only looked for in the codecs we can parse
+        NalCodec codec = info.codec == "H264" ? NalCodec::H264 : info.codec == "H265" ? NalCodec::H265 : NalCodec::None;
+        int length_size = 0;
+        if (info.stream_format == "avc" || info.stream_format == "avc3" || info.stream_format == "hvc1"
+            || info.stream_format == "hev1") {
+            length_size = 4;
+            // lengthSizeMinusOne sits at byte 4 of avcC and byte 21 of hvcC
+            const GValue* value = gst_structure_get_value(s, "codec_data");
+            GstBuffer* codec_data = value ? gst_value_get_buffer(value) : nullptr;
+            GstMapInfo map;
+            if (codec_data && gst_buffer_map(codec_data, &map, GST_MAP_READ)) {
+                size_t at = codec == NalCodec::H264 ? 4 : 21;
+                if (map.size > at) {
+                    length_size = (map.data[at] & 3) + 1;
+                }
+                gst_buffer_unmap(codec_data, &map);
+            }
+        }
+        nal_length_size.store(length_size, std::memory_order_relaxed);
+        nal_codec.store(codec, std::memory_order_relaxed);
+#ifdef HAVE_RTSP_SERVER
+        if (relay_mount) {
+            relay_server->mount(relay_mount, caps);
+        }
+#endif
+
+        gst_structure_get_int(s, "width", &info.width);
+        gst_structure_get_int(s, "height", &info.height);
+        gint num = 0, den = 0;
+        if (gst_structure_get_fraction(s, "framerate", &num, &den) && den > 0) {
+            info.framerate = static_cast<double>(num) / den;
+        }
+
+        // The full caps string also covers codec_data, i.e. out-of-band SPS/PPS
+        gchar* text = gst_caps_to_string(caps);
+        std::string caps_text = text ? text : "";
+        g_free(text);
+
+        std::lock_guard<std::mutex> lock(mutex);
+        if (info != stream_info) {
+            std::cout << "Stream format for " << name << ": " << describe_stream(info) << std::endl;
+            stream_info = info;
+        }
+        if (!last_caps.empty() && caps_text != last_caps) {
+            std::cout << "Caps changed mid-stream for " << name << ": " << describe_stream(info) << std::endl;
+            ++caps_changes;
+            pending_events.push_back({wall_clock_ms(), name, "caps", describe_stream(info)});
+        }
+        last_caps = caps_text;
+    }
+
+    // Parser output is access-unit aligned: one buffer holds one frame, with
+    // parameter sets and SEI as separate NAL units in front of the slices
+    void scan_nal_units(const uint8_t* data, size_t data_size, NalCodec codec, FrameTypeCounts& counts) {
+        int length_size = nal_length_size.load(std::memory_order_relaxed);
+        for_each_nal(data, data_size, length_size, [&](const uint8_t* nal, size_t size) {
+            frame_classifier.on_nal(codec, nal, size, counts);
+            uint32_t id = 0;
+            const char* kind = parameter_sets.on_nal(codec, nal, size, id);
+            if (kind) {
+                std::cout << kind << " " << id << " changed mid-stream for " << name << std::endl;
+                std::string lower = kind;
+                std::transform(lower.begin(), lower.end(), lower.begin(), ::tolower);
+                std::lock_guard<std::mutex> lock(mutex);
+                ++parameter_set_changes;
+                pending_events.push_back({wall_clock_ms(), name, lower, "id " + std::to_string(id)});
+            }
+        });
+        counts.add(frame_classifier.take_frame());
+    }
+
+    static int64_t wall_clock_ms() {
+        return std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::system_clock::now().time_since_epoch()).count();
+    }
+
+    static void on_new_manager(GstElement* src, GstElement* manager, Camera* camera) {
+        g_signal_connect(manager, "new-jitterbuffer", G_CALLBACK(&Camera::on_new_jitterbuffer), camera);
+    }
+
+    static void on_new_jitterbuffer(GstElement* manager, GstElement* jitterbuffer, guint session, guint ssrc,
+                                    Camera* camera) {
+        GstPad* sink_pad = gst_element_get_static_pad(jitterbuffer, "sink");
+        if (!sink_pad) {
+            std::cerr << "No jitterbuffer sink pad for camera: " << camera->uri << std::endl;
+            return;
+        }
+        gst_pad_add_probe(sink_pad, GstPadProbeType(GST_PAD_PROBE_TYPE_BUFFER | GST_PAD_PROBE_TYPE_BUFFER_LIST),
+                          &Camera::on_rtp_probe, camera, NULL);
+        gst_object_unref(sink_pad);
+
+        // Emitted with every RTCP sender report the jitterbuffer receives
+        g_signal_connect(jitterbuffer, "handle-sync", G_CALLBACK(&Camera::on_handle_sync), camera);
+    }
+
+    static void on_handle_sync(GstElement* jitterbuffer, GstStructure* s, Camera* camera) {
+        gint clock_rate = 0;
+        const GValue* value = gst_structure_get_value(s, "sr-buffer");
+        if (!gst_structure_get_int(s, "clock-rate", &clock_rate) || clock_rate <= 0 || !value) {
+            return;
+        }
+        GstBuffer* buffer = gst_value_get_buffer(value);
+        GstMapInfo map;
+        if (!buffer || !gst_buffer_map(buffer, &map, GST_MAP_READ)) {
+            return;
+        }
+        double host_s = std::chrono::duration<double>(std::chrono::system_clock::now().time_since_epoch()).count();
+        // Walk the compound RTCP packet for sender reports (PT 200)
+        for (gsize offset = 0; offset + 20 <= map.size;) {
+            const guint8* packet = map.data + offset;
+            gsize length = ((packet[2] << 8 | packet[3]) + 1) * 4;
+            if (packet[1] == 200 && offset + 20 <= map.size) {
+                auto be32 = [packet](int at) {
+                    return (uint32_t(packet[at]) << 24) | (uint32_t(packet[at + 1]) << 16)
+                           | (uint32_t(packet[at + 2]) << 8) | packet[at + 3];
+                };
+                uint64_t ntp = (uint64_t(be32(8)) << 32) | be32(12);
+                std::lock_guard<std::mutex> lock(camera->rtp_mutex);
+                camera->rtp_streams[be32(4)].clock.on_sender_report(ntp, be32(16), clock_rate, host_s);
+            }
+            offset += length;
+        }
+        gst_buffer_unmap(buffer, &map);
+    }
+
+    static GstPadProbeReturn on_rtp_probe(GstPad* pad, GstPadProbeInfo* info, gpointer user_data) {
+        Camera* camera = static_cast<Camera*>(user_data);
+        if (GST_PAD_PROBE_INFO_TYPE(info) & GST_PAD_PROBE_TYPE_BUFFER_LIST) {
+            GstBufferList* list = GST_PAD_PROBE_INFO_BUFFER_LIST(info);
+            guint length = gst_buffer_list_length(list);
+            for (guint i = 0; i < length; ++i) {
+                camera->count_rtp_packet(gst_buffer_list_get(list, i));
+            }
+        } else {
+            camera->count_rtp_packet(GST_PAD_PROBE_INFO_BUFFER(info));
+        }
+        return GST_PAD_PROBE_OK;
+    }
+
+    // Only the fixed RTP header is read: sequence number, timestamp and SSRC
+    void count_rtp_packet(GstBuffer* buffer) {
+        guint8 header[12];
+        if (gst_buffer_extract(buffer, 0, header, sizeof(header)) != sizeof(header) || (header[0] >> 6) != 2) {
+            return;
+        }
+        uint16_t seq = static_cast<uint16_t>((header[2] << 8) | header[3]);
+        uint32_t timestamp = (uint32_t(header[4]) << 24) | (uint32_t(header[5]) << 16) | (uint32_t(header[6]) << 8) | header[7];
+        uint32_t ssrc = (uint32_t(header[8]) << 24) | (uint32_t(header[9]) << 16) | (uint32_t(header[10]) << 8) | header[11];
+        std::lock_guard<std::mutex> lock(rtp_mutex);
+        RtpStreamStats& stream = rtp_streams[ssrc];
+        stream.sequence.on_packet(seq);
+        if (stream.clock.has_sender_report()) {
+            stream.clock.on_rtp(timestamp,
+                std::chrono::duration<double>(std::chrono::system_clock::now().time_since_epoch()).count());
+        }
+    }
+
     static GstFlowReturn on_new_sample(GstElement* sink, Camera* camera) {
         GstSample* sample = gst_app_sink_pull_sample(GST_APP_SINK(sink));
         if (sample) {
+            GstBuffer* buffer = gst_sample_get_buffer(sample);
+            auto now = std::chrono::steady_clock::now();
+            int64_t now_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(now.time_since_epoch()).count();
+            // Lock-free estimators and watchdog first, only the tumbling counters need the mutex
+            camera->estimators.on_frame(now_ns);
+            camera->watch.last_frame_ns.store(now_ns, std::memory_order_relaxed);
+            // Encoded-domain checks share one mapping of the frame
+            bool keyframe = buffer && !GST_BUFFER_FLAG_IS_SET(buffer, GST_BUFFER_FLAG_DELTA_UNIT);
+            if (keyframe && decode_every_ns > 0) {
+                camera->maybe_submit_keyframe(sample, buffer, now_ns);
+            }
+            GstMapInfo map;
+            FrameTypeCounts frame_types;
+            bool hashed = false;
+            if (buffer && gst_buffer_map(buffer, &map, GST_MAP_READ)) {
+                NalCodec codec = camera->nal_codec.load(std::memory_order_relaxed);
+                if (codec != NalCodec::None) {
+                    camera->scan_nal_units(map.data, map.size, codec, frame_types);
+                }
+                camera->frozen_detector.on_frame(map.data, map.size, keyframe);
+                if (camera->clip_ring) {
+                    camera->clip_ring->push(gst_sample_get_caps(sample), buffer, map.data, map.size, keyframe, now_ns);
+                }
+                hashed = keyframe;
+                gst_buffer_unmap(buffer, &map);
+            }
+#ifdef HAVE_RTSP_SERVER
+            if (camera->relay_mount && buffer) {
+                camera->relay_mount->push(buffer);
+            }
+#endif
+            if (keyframe || frame_types.parameter_sets > 0) {
+                camera->cache_keyframe(gst_sample_get_caps(sample), buffer, keyframe, frame_types.parameter_sets > 0);
+            }
             std::lock_guard<std::mutex> lock(camera->mutex);
+            if (hashed) {
+                camera->keyframe_hashes.push_back(camera->frozen_detector.keyframe_hash());
+                if (camera->keyframe_hashes.size() > duplicates::kKeyframeHashes) {
+                    camera->keyframe_hashes.pop_front();
+                }
+            }
             camera->frame_count++;
+            camera->byte_count += buffer ? gst_buffer_get_size(buffer) : 0;
+            camera->frame_types.merge(frame_types);
+            // Accumulate inter-arrival gaps for the jitter estimate
+            if (camera->last_arrival.time_since_epoch().count() != 0) {
+                double gap_ms = std::chrono::duration<double, std::milli>(now - camera->last_arrival).count();
+                camera->gap_count++;
+                camera->gap_sum_ms += gap_ms;
+                camera->gap_sq_sum_ms += gap_ms * gap_ms;
+            }
+            camera->last_arrival = now;
             gst_sample_unref(sample); // Free the sample
             return GST_FLOW_OK;
         } else {
@@ -148,8 +854,197 @@ public:
         }
     }
 
+    // At most one keyframe per camera is in the decode pool at a time; a full
+    // queue just means trying again with the next keyframe
+    void maybe_submit_keyframe(GstSample* sample, GstBuffer* buffer, int64_t now_ns) {
+        GstCaps* caps = gst_sample_get_caps(sample);
+        if (!caps || now_ns < next_decode_ns || decode_pending.exchange(true)) {
+            return;
+        }
+        if (decode_pool->submit(name, caps, buffer, [this](DecodedFramePtr frame) { on_decoded(frame); })) {
+            next_decode_ns = now_ns + decode_every_ns;
+        } else {
+            decode_pending = false;
+        }
+    }
+
+    // Keeps references, not copies, to the newest keyframe and to the newest
+    // Annex-B access unit with parameter sets, for snapshots
+    void cache_keyframe(GstCaps* caps, GstBuffer* buffer, bool keyframe, bool has_parameter_sets) {
+        std::lock_guard<std::mutex> lock(keyframe_mutex);
+        if (has_parameter_sets && nal_length_size.load(std::memory_order_relaxed) == 0) {
+            if (latest_config) {
+                gst_buffer_unref(latest_config);
+            }
+            latest_config = gst_buffer_ref(buffer);
+        }
+        if (keyframe && caps) {
+            if (latest_keyframe) {
+                gst_buffer_unref(latest_keyframe);
+            }
+            latest_keyframe = gst_buffer_ref(buffer);
+            latest_keyframe_has_config = has_parameter_sets;
+            if (caps != latest_keyframe_caps) {
+                if (latest_keyframe_caps) {
+                    gst_caps_unref(latest_keyframe_caps);
+                }
+                latest_keyframe_caps = gst_caps_ref(caps);
+            }
+        }
+    }
+
+    // The cached keyframe, decodable on its own: when it carries no parameter
+    // sets in-band, the last ones seen are put in front of it. Both results are
+    // new references; null before the first keyframe.
+    GstBuffer* snapshot_keyframe(GstCaps*& caps) {
+        std::lock_guard<std::mutex> lock(keyframe_mutex);
+        if (!latest_keyframe) {
+            return nullptr;
+        }
+        caps = gst_caps_ref(latest_keyframe_caps);
+        NalCodec codec = nal_codec.load(std::memory_order_relaxed);
+        GstMapInfo map;
+        std::vector<uint8_t> config;
+        if (!latest_keyframe_has_config && latest_config && gst_buffer_map(latest_config, &map, GST_MAP_READ)) {
+            config = extract_parameter_sets(codec, map.data, map.size, 0);
+            gst_buffer_unmap(latest_config, &map);
+        }
+        if (config.empty()) {
+            return gst_buffer_ref(latest_keyframe);
+        }
+        // The keyframe's memory is shared with the appended buffer, not copied
+        GstBuffer* head = gst_buffer_new_allocate(NULL, config.size(), NULL);
+        gst_buffer_fill(head, 0, config.data(), config.size());
+        return gst_buffer_append(head, gst_buffer_ref(latest_keyframe));
+    }
+
+    // Decodes the cached keyframe on the decode pool and encodes it as JPEG;
+    // returns 200, or 503 when there is no keyframe yet or decoding failed
+    int snapshot_jpeg(std::vector<uint8_t>& jpeg) {
+        GstCaps* caps = nullptr;
+        GstBuffer* keyframe = snapshot_keyframe(caps);
+        if (!keyframe) {
+            return 503;
+        }
+        auto decoded = std::make_shared<std::promise<DecodedFramePtr>>();
+        std::future<DecodedFramePtr> result = decoded->get_future();
+        bool queued = decode_pool->submit(name, caps, keyframe, [decoded](DecodedFramePtr frame) { decoded->set_value(frame); });
+        gst_buffer_unref(keyframe);
+        gst_caps_unref(caps);
+        if (!queued || result.wait_for(std::chrono::seconds(5)) != std::future_status::ready) {
+            return 503;
+        }
+        DecodedFramePtr frame;
+        try {
+            frame = result.get();
+        } catch (const std::future_error&) {
+            return 503;  // Dropped by a stopping pool
+        }
+        if (!frame) {
+            return 503;
+        }
+        // The encoder takes GRAY8 rows a multiple of 4 wide; at most 3 columns are cut
+        int width = frame->width & ~3;
+        std::vector<uint8_t> canvas(size_t(width) * frame->height);
+        for (int y = 0; y < frame->height; ++y) {
+            std::memcpy(&canvas[size_t(y) * width], &frame->luma[size_t(y) * frame->width], width);
+        }
+        return width > 0 && mosaic::encode(canvas, width, frame->height, false, jpeg) ? 200 : 503;
+    }
+
+    // Dumps the pre-event buffer when the camera turns unhealthy (an empty
+    // anomaly means healthy); once per episode and at most once per cooldown
+    void maybe_dump_clip(const std::string& anomaly) {
+        bool was_anomalous = clip_anomaly;
+        clip_anomaly = !anomaly.empty();
+        int64_t now_ns = steady_now_ns();
+        if (!clip_anomaly || was_anomalous || now_ns < next_clip_ns) {
+            return;
+        }
+        std::unique_ptr<Clip> clip = clip_ring->copy(name, anomaly);
+        if (clip) {
+            std::cout << "Saving pre-event clip for " << name << " (" << anomaly << ", " << clip->frames.size()
+                      << " frames)" << std::endl;
+            clip_writer->submit(std::move(clip));
+            next_clip_ns = now_ns + kClipCooldownNs;
+        }
+    }
+
+    // Called on a decode pool worker, which also pays for the image checks
+    void on_decoded(DecodedFramePtr frame) {
+        if (frame) {
+            ImageQuality quality = image_metrics::analyze(frame->luma.data(), frame->width, frame->height);
+            // Only this camera's one pending decode touches the tracker
+            SceneState scene = scene_tracker.on_fingerprint(fingerprint::dhash(frame->luma.data(), frame->width, frame->height));
+            bool moved_changed;
+            {
+                std::lock_guard<std::mutex> lock(decoded_mutex);
+                if (quality.state != image_quality.state) {
+                    std::cout << "Image state for " << name << ": " << quality.state << std::endl;
+                }
+                moved_changed = scene.moved != scene_state.moved;
+                last_decoded = frame;
+                image_quality = quality;
+                scene_state = scene;
+            }
+            if (moved_changed) {
+                std::string detail = (scene.moved ? "moved, distance " : "restored, distance ") + std::to_string(scene.distance);
+                std::cout << "Scene " << detail << ": " << name << std::endl;
+                std::lock_guard<std::mutex> lock(mutex);
+                pending_events.push_back({wall_clock_ms(), name, "scene", detail});
+            }
+        }
+        decode_pending = false;
+    }
+
+    void reconnect() {
+        std::cout << "Reconnecting camera: " << name << std::endl;
+        stop();
+        start();
+        ++reconnects;
+    }
+
+    // Called on the watchdog thread on every check while no frames arrive
+    void on_stall(int64_t age_ns) {
+        if (!stall_reported.exchange(true)) {
+            std::cout << "Stall detected: " << name << ", no frame for " << age_ns / 1000000 << " ms" << std::endl;
+        }
+        if (steady_now_ns() - watch.armed_ns.load() >= kReconnectBackoffNs) {
+            request_reconnect();
+        }
+    }
+
+    // The camera's own thread does the reconnect on its next wake-up
+    void request_reconnect() {
+        {
+            std::lock_guard<std::mutex> wake_lock(wake_mutex);
+            reconnect_requested = true;
+        }
+        wake.notify_one();
+    }
+
+    // Takes effect from the camera's last tick, see run()
+    void set_interval(std::chrono::milliseconds interval) {
+        {
+            std::lock_guard<std::mutex> wake_lock(wake_mutex);
+            requested_interval_ms = interval.count();
+        }
+        wake.notify_one();
+    }
+
+    int64_t interval_ms() const { return current_interval_ms.load(std::memory_order_relaxed); }
+
+    const std::string& get_uri() const { return uri; }
+
+    // Tells shared-memory readers the camera is gone; call once run() has returned
+    void unpublish() { metrics_segment.remove_camera(shm_slot); }
+
     void set_running(bool state) {
-        running = state;
+        {
+            std::lock_guard<std::mutex> wake_lock(wake_mutex);
+            running = state;
+        }
+        wake.notify_one();
     }
 
 private:
@@ -161,9 +1056,130 @@ private:
     GstElement* source;
     const gchar* encoding_name;
     int frame_count;
-    bool running;
-    std::mutex mutex;  // To protect frame_count
+    uint64_t byte_count = 0;
+    uint64_t frames_total = 0;
+    std::chrono::steady_clock::time_point last_arrival{};
+    int gap_count = 0;
+    double gap_sum_ms = 0.0;
+    double gap_sq_sum_ms = 0.0;
+    uint32_t reconnects = 0;
+    int shm_slot = -1;  // Slot in the shared-memory segment, -1 if not published
+    // Cached entries of fps_map / downtime_map / rollup_map, guarded by fps_mutex
+    CameraSample* sample_slot = nullptr;
+    int* downtime_slot = nullptr;
+    RollupSeries* rollup_slot = nullptr;
+    std::atomic<bool> running;
+    StreamInfo stream_info;  // Negotiated caps of the parsebin output, guarded by mutex
+    std::string last_caps;  // Full caps string, guarded by mutex
+    uint32_t caps_changes = 0;  // Per interval, guarded by mutex
+    uint32_t parameter_set_changes = 0;
+    std::vector<StreamEvent> pending_events;  // Guarded by mutex until run() moves them to stream_events
+    std::atomic<NalCodec> nal_codec{NalCodec::None};  // Set from caps, read per frame
+    std::atomic<int> nal_length_size{0};  // 0 for Annex-B
+    ParameterSetTracker parameter_sets;  // Only touched by the streaming thread
+    FrameClassifier frame_classifier;  // Only touched by the streaming thread
+    FrameTypeCounts frame_types;  // Per interval, guarded by mutex
+    FrozenDetector frozen_detector;  // Fed by the streaming thread, frozen() read by run()
+    bool frozen_reported = false;  // Only touched by run()
+    std::deque<uint32_t> keyframe_hashes;  // Recent keyframe payload hashes, guarded by mutex
+    std::unique_ptr<ClipRing> clip_ring;  // Pre-event frames, only with --clip-dir
+#ifdef HAVE_RTSP_SERVER
+    std::shared_ptr<RelayMount> relay_mount;  // Only with --relay, shared with the server
+#endif
+    std::mutex keyframe_mutex;  // Protects the cached keyframe references below
+    GstBuffer* latest_keyframe = nullptr;
+    GstCaps* latest_keyframe_caps = nullptr;
+    bool latest_keyframe_has_config = false;
+    GstBuffer* latest_config = nullptr;  // Annex-B streams only; avc / hvc1 carry theirs in the caps
+    bool clip_anomaly = false;  // run() only
+    int64_t next_clip_ns = 0;  // run() only
+    int64_t next_decode_ns = 0;  // Streaming thread only
+    std::atomic<bool> decode_pending{false};  // A keyframe of ours is queued or decoding
+    std::mutex decoded_mutex;  // Protects last_decoded
+    DecodedFramePtr last_decoded;  // Latest sampled keyframe, for image content checks
+    ImageQuality image_quality;  // Of last_decoded, guarded by decoded_mutex
+    SceneTracker scene_tracker;  // Decode callback only
+    SceneState scene_state;  // Of last_decoded, guarded by decoded_mutex
+    std::mutex mutex;  // To protect frame_count and the other per-interval counters
+    std::mutex rtp_mutex;  // Protects rtp_streams, taken per packet by the jitterbuffer probes
+    std::map<uint32_t, RtpStreamStats> rtp_streams;  // Keyed by SSRC
+    std::mutex tracks_mutex;  // Protects the tracks vector, not the counters inside
+    std::vector<std::unique_ptr<Track>> tracks;  // One per RTSP media stream, kept across reconnects
+    FpsEstimators estimators;  // Sliding window and EWMA, updated without the mutex
+    StallWatch watch;  // Last-frame age, checked by the stall watchdog
+    std::atomic<bool> reconnect_requested{false};
+    std::atomic<int64_t> requested_interval_ms{0};  // Set by set_interval, taken by run()
+    std::atomic<int64_t> current_interval_ms{0};
+    std::atomic<bool> stall_reported{false};
+    std::mutex wake_mutex;  // Wakes run() early for watchdog reconnects or shutdown
+    std::condition_variable wake;
+};
+
+// Running cameras by name; cameras sharing a session (shared_sessions) are not
+// in here. Changed at runtime through the control socket.
+struct CameraHandle {
+    std::shared_ptr<Camera> camera;
+    std::thread thread;
 };
+std::mutex cameras_mutex;
+std::map<std::string, CameraHandle> running_cameras;
+
+bool add_camera(const std::string& name, const std::string& uri, std::chrono::milliseconds interval) {
+    std::lock_guard<std::mutex> lock(cameras_mutex);
+    if (running_cameras.count(name) || shared_sessions.count(name)) {
+        return false;
+    }
+    auto camera = std::make_shared<Camera>(name, uri, interval);
+    camera->start();
+    CameraHandle& handle = running_cameras[name];
+    handle.camera = camera;
+    handle.thread = std::thread(&Camera::run, camera.get(), interval); // Start camera run in a thread
+    if (clip_arena) {
+        clip_arena->set_cameras(running_cameras.size());
+    }
+    return true;
+}
+
+// Stops the camera and drops its figures from the next report
+bool remove_camera(const std::string& name) {
+    CameraHandle handle;
+    {
+        std::lock_guard<std::mutex> lock(cameras_mutex);
+        auto found = running_cameras.find(name);
+        if (found == running_cameras.end()) {
+            return false;
+        }
+        handle = std::move(found->second);
+        running_cameras.erase(found);
+        if (clip_arena) {
+            clip_arena->set_cameras(running_cameras.size());
+        }
+    }
+    handle.camera->set_running(false);
+    handle.thread.join();
+    handle.camera->stop();
+    handle.camera->unpublish();
+    // Queued decode callbacks point at the camera
+    if (decode_pool) {
+        decode_pool->cancel(name);
+    }
+    {
+        std::lock_guard<std::mutex> fps_lock(fps_mutex);
+        fps_map.erase(name);
+        downtime_map.erase(name);
+        rollup_map.erase(name);
+    }
+    return true;
+}
+
+// Resolves cameras sharing a session to the camera that owns it
+std::shared_ptr<Camera> find_camera(const std::string& name) {
+    auto alias = shared_sessions.find(name);
+    const std::string& owner = alias != shared_sessions.end() ? alias->second : name;
+    std::lock_guard<std::mutex> lock(cameras_mutex);
+    auto found = running_cameras.find(owner);
+    return found != running_cameras.end() ? found->second.camera : nullptr;
+}
 
 std::map<std::string, std::string> read_camera_uris(const std::string& filename) {
     std::map<std::string, std::string> camera_uris;
@@ -187,53 +1203,450 @@ std::map<std::string, std::string> read_camera_uris(const std::string& filename)
     return camera_uris;
 }
 
-void print_fps(int interval) {
-    while (true) {
-        std::this_thread::sleep_for(std::chrono::seconds(interval));
-        
-        std::lock_guard<std::mutex> fps_lock(fps_mutex);
-        size_t count = fps_map.size();
-        size_t current = 0;
+void print_snapshot(const MetricsSnapshot& snapshot) {
+    size_t count = snapshot.cameras.size();
+    size_t current = 0;
+
+    // Get the tick time
+    std::time_t now = snapshot.timestamp_ms / 1000;
+    std::tm* local_time = std::localtime(&now);
+
+    // Print the timestamp
+    std::cout << "[\033[1;34m" << std::put_time(local_time, "%d:%m:%Y %H:%M:%S") << "]\033[0m ";
+
+    std::cout << std::fixed << std::setprecision(console_precision);
+    for (const auto& camera : snapshot.cameras) {
+        ++current;
+        double fps = estimate(camera, console_estimator);
+        if (fps < 5) {
+            // Print in red if FPS is 0
+            std::cout << "\033[1;31m" << camera.name << ": " << fps << " FPS\033[0m";
+        } else {
+            // Normal print
+            std::cout << camera.name << ": " << fps << " FPS";
+        }
+        if (camera.rtp.lost > 0) {
+            std::cout << " (" << std::setprecision(1) << camera.rtp.loss_pct() << "% loss)" << std::setprecision(console_precision);
+        }
+        if (!std::isnan(camera.drift_ppm)) {
+            std::cout << " [" << std::showpos << std::setprecision(0) << camera.drift_ppm << std::noshowpos << " ppm";
+            if (!std::isnan(camera.latency_p50_ms)) {
+                std::cout << ", " << camera.latency_p50_ms << " ms";
+            }
+            std::cout << "]" << std::setprecision(console_precision);
+        }
+        if (camera.frozen) {
+            std::cout << " \033[1;31m(frozen)\033[0m";
+        }
+        if (camera.scene.moved) {
+            std::cout << " \033[1;31m(moved)\033[0m";
+        }
+        if (camera.relay_clients > 0) {
+            std::cout << " <relay " << camera.relay_clients << ", " << std::setprecision(0) << camera.relay_egress_kbps
+                      << " kbps>" << std::setprecision(console_precision);
+        }
+        if (!camera.duplicate_group.empty() && camera.duplicate_group != camera.name) {
+            std::cout << " (same as " << camera.duplicate_group << ")";
+        }
+        if (camera.image.valid && camera.image.state != "ok") {
+            std::cout << " \033[1;31m(" << camera.image.state << ")\033[0m";
+        }
+        // Per-track rates only matter once a camera carries more than its video
+        if (camera.tracks.size() > 1) {
+            std::cout << " {";
+            for (size_t i = 0; i < camera.tracks.size(); ++i) {
+                std::cout << (i ? ", " : "") << camera.tracks[i].track << " " << camera.tracks[i].rate << "/s";
+            }
+            std::cout << "}";
+        }
 
+        // Print a comma unless it's the last element
+        if (current < count) {
+            std::cout << ", ";
+        }
+    }
+    std::cout << std::endl;
+}
 
-        // Get the current time
-        std::time_t now = std::time(nullptr);
-        std::tm* local_time = std::localtime(&now);
+// Marks every camera with its duplicate group and reports groups that are new
+void update_duplicate_groups(MetricsSnapshot& snapshot) {
+    std::vector<std::vector<std::string>> groups = duplicates::find_groups(snapshot.cameras);
+    std::map<std::string, std::string> group_of;
+    for (const auto& group : groups) {
+        std::string members;
+        for (const auto& name : group) {
+            group_of[name] = group.front();
+            members += (members.empty() ? "" : ",") + name;
+        }
+        if (std::find(duplicate_groups.begin(), duplicate_groups.end(), group) == duplicate_groups.end()) {
+            std::cout << "Duplicate streams: " << members << std::endl;
+            snapshot.events.push_back({snapshot.timestamp_ms, group.front(), "duplicate", members});
+        }
+    }
+    for (auto& camera : snapshot.cameras) {
+        auto found = group_of.find(camera.name);
+        camera.duplicate_group = found != group_of.end() ? found->second : std::string();
+    }
+    duplicate_groups.swap(groups);
+}
 
-        // Print the timestamp
-        std::cout << "[\033[1;34m" << std::put_time(local_time, "%d:%m:%Y %H:%M:%S") << "]\033[0m ";
+void print_fps(std::chrono::milliseconds interval) {
+    auto deadline = std::chrono::steady_clock::now();
+    while (true) {
+        deadline += interval;
+        {
+            std::unique_lock<std::mutex> lock(print_mutex);
+            if (print_wake.wait_until(lock, deadline, [] { return print_stopping; })) {
+                return;
+            }
+        }
 
-        for (const auto& entry : fps_map) {
-            ++current;
-            if (entry.second < 5) {
-                // Print in red if FPS is 0
-                std::cout << "\033[1;31m" << entry.first << ": " << entry.second << " FPS\033[0m";
-            } else {
-                // Normal print
-                std::cout << entry.first << ": " << entry.second << " FPS";
+        // Copy the maps into an immutable snapshot and release fps_mutex before any I/O
+        auto snapshot = std::make_shared<MetricsSnapshot>();
+        snapshot->timestamp_ms = std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::system_clock::now().time_since_epoch()).count();
+        {
+            std::lock_guard<std::mutex> fps_lock(fps_mutex);
+            snapshot->cameras.reserve(fps_map.size());
+            for (const auto& entry : fps_map) {
+                snapshot->cameras.push_back(entry.second);
+            }
+            if (emit_rollups) {
+                snapshot->rollups.swap(closed_rollups);
+            }
+            // Cameras sharing a session report the figures of the session they share
+            for (const auto& [alias, primary] : shared_sessions) {
+                auto found = fps_map.find(primary);
+                if (found != fps_map.end()) {
+                    CameraSample sample = found->second;
+                    sample.name = alias;
+                    snapshot->cameras.push_back(std::move(sample));
+                }
             }
+            snapshot->events.swap(stream_events);
+            closed_rollups.clear();
+        }
+        if (!shared_sessions.empty()) {
+            std::sort(snapshot->cameras.begin(), snapshot->cameras.end(),
+                      [](const CameraSample& a, const CameraSample& b) { return a.name < b.name; });
+        }
+        update_duplicate_groups(*snapshot);
 
-            // Print a comma unless it's the last element
-            if (current < count) {
-                std::cout << ", ";
+        if (dashboard) {
+            dashboard->submit(snapshot);
+        } else if (console_output) {
+            print_snapshot(*snapshot);
+        }
+        for (auto& writer : structured_writers) {
+            writer->submit(snapshot);
+        }
+        if (metrics_store) {
+            metrics_store->append(*snapshot);
+        }
+        if (mosaic_writer) {
+            mosaic_writer->submit(snapshot);
+        }
+    }
+}
+
+// Accepts "5" or "2.5s" (seconds) and "200ms"; returns 0 on malformed input
+std::chrono::milliseconds parse_interval(const std::string& text) {
+    try {
+        size_t used = 0;
+        double value = std::stod(text, &used);
+        std::string unit = text.substr(used);
+        if (unit == "ms") {
+            return std::chrono::milliseconds(static_cast<int64_t>(value));
+        }
+        if (unit.empty() || unit == "s") {
+            return std::chrono::milliseconds(static_cast<int64_t>(value * 1000));
+        }
+    } catch (const std::exception&) {
+    }
+    return std::chrono::milliseconds(0);
+}
+
+// One --control command; responses start with OK or ERR, one item per line
+std::string handle_control(const std::vector<std::string>& words, std::chrono::milliseconds default_interval) {
+    const std::string& command = words[0];
+    std::ostringstream out;
+    if (command == "help") {
+        out << "OK\n"
+            << "list\n"
+            << "stats <camera>\n"
+            << "add <camera> <uri>\n"
+            << "remove <camera>\n"
+            << "restart <camera>\n"
+            << "interval <camera> <interval>[ms|s]\n"
+            << "rollups <camera> <resolution>[ms|s] [count]\n";
+    } else if (command == "list" && words.size() == 1) {
+        std::map<std::string, std::string> uris;
+        {
+            std::lock_guard<std::mutex> lock(cameras_mutex);
+            for (const auto& entry : running_cameras) {
+                uris[entry.first] = entry.second.camera->get_uri();
+            }
+        }
+        std::lock_guard<std::mutex> fps_lock(fps_mutex);
+        out << "OK " << uris.size() + shared_sessions.size() << " cameras\n";
+        for (const auto& [name, uri] : uris) {
+            auto found = fps_map.find(name);
+            if (found == fps_map.end()) {
+                out << name << " starting " << uri << "\n";
+                continue;
             }
+            const CameraSample& sample = found->second;
+            out << name << " " << (sample.stalled ? "stalled" : sample.frozen ? "frozen" : "ok") << " "
+                << std::fixed << std::setprecision(1) << sample.fps << "fps " << uri << "\n";
         }
-        std::cout << std::endl;
+        for (const auto& [alias, primary] : shared_sessions) {
+            out << alias << " shares " << primary << "\n";
+        }
+    } else if (command == "stats" && words.size() == 2) {
+        std::shared_ptr<Camera> camera = find_camera(words[1]);
+        if (!camera) {
+            return "ERR unknown camera " + words[1] + "\n";
+        }
+        auto alias = shared_sessions.find(words[1]);
+        CameraSample sample;
+        {
+            std::lock_guard<std::mutex> fps_lock(fps_mutex);
+            auto found = fps_map.find(alias != shared_sessions.end() ? alias->second : words[1]);
+            if (found == fps_map.end()) {
+                return "ERR no figures for " + words[1] + " yet\n";
+            }
+            sample = found->second;
+        }
+        out << "OK\n" << std::fixed << std::setprecision(2)
+            << "uri " << camera->get_uri() << "\n"
+            << "interval_ms " << camera->interval_ms() << "\n"
+            << "fps " << sample.fps << "\n"
+            << "fps_sliding " << sample.fps_sliding << "\n"
+            << "fps_ewma " << sample.fps_ewma << "\n"
+            << "bitrate_kbps " << sample.bitrate_kbps << "\n"
+            << "jitter_ms " << sample.jitter_ms << "\n"
+            << "downtime " << sample.downtime << "\n"
+            << "stalled " << sample.stalled << "\n"
+            << "frozen " << sample.frozen << "\n"
+            << "frame_age_ms " << sample.frame_age_ms << "\n"
+            << "packet_loss_pct " << sample.rtp.loss_pct() << "\n"
+            << "stream " << describe_stream(sample.stream) << "\n";
+    } else if (command == "rollups" && (words.size() == 3 || words.size() == 4)) {
+        auto alias = shared_sessions.find(words[1]);
+        const std::string& owner = alias != shared_sessions.end() ? alias->second : words[1];
+        int64_t resolution_ms = parse_interval(words[2]).count();
+        size_t count = 10;
+        if (words.size() == 4) {
+            try {
+                count = std::stoul(words[3]);
+            } catch (const std::exception&) {
+                return "ERR invalid count " + words[3] + "\n";
+            }
+        }
+        std::vector<RollupBucket> buckets;
+        {
+            std::lock_guard<std::mutex> fps_lock(fps_mutex);
+            auto series = rollup_map.find(owner);
+            if (series == rollup_map.end()) {
+                return "ERR no rollups for " + words[1] + " yet\n";
+            }
+            const RollupRing* ring = series->second.find_ring(resolution_ms);
+            if (!ring) {
+                return "ERR no rollups at " + words[2] + " (1s, 10s, 60s or 3600s, not finer than the interval)\n";
+            }
+            // Oldest first
+            for (size_t age = std::min(count, ring->size()); age-- > 0;) {
+                buckets.push_back(ring->at(age));
+            }
+        }
+        out << "OK " << buckets.size() << " buckets\n" << std::fixed << std::setprecision(1);
+        for (const auto& bucket : buckets) {
+            std::time_t start = bucket.start_ms / 1000;
+            std::tm local;
+            localtime_r(&start, &local);
+            out << std::put_time(&local, "%Y-%m-%d %H:%M:%S") << " min " << bucket.min_fps << " avg " << bucket.avg_fps
+                << " max " << bucket.max_fps << " bytes " << bucket.bytes << " stalls " << bucket.stalls << "\n";
+        }
+    } else if (command == "add" && words.size() == 3) {
+        if (!add_camera(words[1], words[2], default_interval)) {
+            return "ERR camera " + words[1] + " already exists\n";
+        }
+        out << "OK added " << words[1] << "\n";
+    } else if (command == "remove" && words.size() == 2) {
+        // Cameras sharing a session would lose their source
+        for (const auto& [alias, primary] : shared_sessions) {
+            if (alias == words[1] || primary == words[1]) {
+                return "ERR " + words[1] + " shares its session, started with --share-identical\n";
+            }
+        }
+        if (!remove_camera(words[1])) {
+            return "ERR unknown camera " + words[1] + "\n";
+        }
+        out << "OK removed " << words[1] << "\n";
+    } else if (command == "restart" && words.size() == 2) {
+        std::shared_ptr<Camera> camera = find_camera(words[1]);
+        if (!camera) {
+            return "ERR unknown camera " + words[1] + "\n";
+        }
+        camera->request_reconnect();
+        out << "OK restarting " << words[1] << "\n";
+    } else if (command == "interval" && words.size() == 3) {
+        std::shared_ptr<Camera> camera = find_camera(words[1]);
+        if (!camera) {
+            return "ERR unknown camera " + words[1] + "\n";
+        }
+        std::chrono::milliseconds interval = parse_interval(words[2]);
+        if (interval.count() <= 0) {
+            return "ERR invalid interval " + words[2] + "\n";
+        }
+        camera->set_interval(interval);
+        out << "OK interval of " << words[1] << " is now " << interval.count() << "ms\n";
+    } else {
+        return "ERR unknown command, try help\n";
     }
+    return out.str();
 }
 
 int main(int argc, char* argv[]) {
     gst_init(&argc, &argv);
 
     if (argc < 2) {
-        std::cerr << "Usage: " << argv[0] << " <interval_in_seconds>" << std::endl;
+        std::cerr << "Usage: " << argv[0] << " <interval>[ms|s] [--shm <name>]"
+                  << " [--json <path|->[@estimator]] [--csv <path|->[@estimator]] [--console <estimator>]"
+                  << " [--rotate-size <MB>] [--rotate-time <seconds>]"
+                  << " [--tsdb <dir>] [--rollups] [--stall-timeout <interval>]"
+                  << " [--decode-every <interval>] [--decode-workers <n>]"
+                  << " [--mosaic <file.jpg|png>] [--mosaic-every <interval>] [--mosaic-tile <W>x<H>]"
+                  << " [--share-identical] [--dashboard]"
+                  << " [--snapshot-port <port>] [--relay <port>] [--control <socket>]"
+                  << " [--clip-dir <dir>] [--clip-length <interval>] [--clip-memory <MB>] [--clip-format mkv|mp4]" << std::endl;
         return 1;
     }
 
-    int interval = std::stoi(argv[1]);
+    std::chrono::milliseconds interval = parse_interval(argv[1]);
+    if (interval.count() <= 0) {
+        std::cerr << "Invalid interval: " << argv[1] << " (e.g. 5, 2.5s or 200ms)" << std::endl;
+        return 1;
+    }
+    std::string shm_name;
+    std::string mosaic_path;
+    bool share_identical = false;
+    bool use_dashboard = false;
+    int snapshot_port = 0;
+    int relay_port = 0;
+    std::string control_path;
+    std::string clip_dir;
+    size_t clip_memory_mb = 512;
+    bool clip_mp4 = false;
+    std::chrono::milliseconds mosaic_every(60000);
+    int tile_width = 320;
+    int tile_height = 180;
+    std::vector<std::tuple<OutputFormat, std::string, Estimator>> outputs;
+    size_t rotate_bytes = 0;
+    int rotate_seconds = 0;
+    for (int i = 2; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--shm" && i + 1 < argc) {
+            shm_name = argv[++i];
+        } else if ((arg == "--json" || arg == "--csv") && i + 1 < argc) {
+            // An optional @tumbling, @sliding or @ewma suffix picks the estimator for this output
+            std::string path = argv[++i];
+            Estimator estimator = Estimator::Tumbling;
+            size_t at = path.rfind('@');
+            if (at != std::string::npos && parse_estimator(path.substr(at + 1), estimator)) {
+                path.erase(at);
+            }
+            outputs.emplace_back(arg == "--json" ? OutputFormat::JsonLines : OutputFormat::Csv, path, estimator);
+        } else if (arg == "--console" && i + 1 < argc) {
+            if (!parse_estimator(argv[++i], console_estimator)) {
+                std::cerr << "Unknown estimator: " << argv[i] << std::endl;
+                return 1;
+            }
+        } else if (arg == "--rotate-size" && i + 1 < argc) {
+            rotate_bytes = std::stoul(argv[++i]) * 1024 * 1024;
+        } else if (arg == "--rotate-time" && i + 1 < argc) {
+            rotate_seconds = std::stoi(argv[++i]);
+        } else if (arg == "--stall-timeout" && i + 1 < argc) {
+            std::chrono::milliseconds timeout = parse_interval(argv[++i]);
+            if (timeout.count() <= 0) {
+                std::cerr << "Invalid stall timeout: " << argv[i] << std::endl;
+                return 1;
+            }
+            stall_timeout_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(timeout).count();
+        } else if (arg == "--decode-every" && i + 1 < argc) {
+            std::chrono::milliseconds every = parse_interval(argv[++i]);
+            if (every.count() <= 0) {
+                std::cerr << "Invalid decode interval: " << argv[i] << std::endl;
+                return 1;
+            }
+            decode_every_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(every).count();
+        } else if (arg == "--decode-workers" && i + 1 < argc) {
+            decode_workers = std::max(1, std::stoi(argv[++i]));
+        } else if (arg == "--mosaic" && i + 1 < argc) {
+            mosaic_path = argv[++i];
+        } else if (arg == "--mosaic-every" && i + 1 < argc) {
+            mosaic_every = parse_interval(argv[++i]);
+            if (mosaic_every.count() <= 0) {
+                std::cerr << "Invalid mosaic interval: " << argv[i] << std::endl;
+                return 1;
+            }
+        } else if (arg == "--mosaic-tile" && i + 1 < argc) {
+            if (std::sscanf(argv[++i], "%dx%d", &tile_width, &tile_height) != 2 || tile_width < 16 || tile_height < 16) {
+                std::cerr << "Invalid mosaic tile size: " << argv[i] << " (e.g. 320x180)" << std::endl;
+                return 1;
+            }
+        } else if (arg == "--clip-dir" && i + 1 < argc) {
+            clip_dir = argv[++i];
+        } else if (arg == "--clip-length" && i + 1 < argc) {
+            std::chrono::milliseconds length = parse_interval(argv[++i]);
+            if (length.count() <= 0) {
+                std::cerr << "Invalid clip length: " << argv[i] << std::endl;
+                return 1;
+            }
+            clip_window_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(length).count();
+        } else if (arg == "--clip-memory" && i + 1 < argc) {
+            clip_memory_mb = std::max<size_t>(1, std::stoul(argv[++i]));
+        } else if (arg == "--clip-format" && i + 1 < argc) {
+            std::string clip_format = argv[++i];
+            if (clip_format != "mkv" && clip_format != "mp4") {
+                std::cerr << "Unknown clip format: " << clip_format << " (expected mkv or mp4)" << std::endl;
+                return 1;
+            }
+            clip_mp4 = clip_format == "mp4";
+        } else if (arg == "--snapshot-port" && i + 1 < argc) {
+            snapshot_port = std::stoi(argv[++i]);
+        } else if (arg == "--relay" && i + 1 < argc) {
+            relay_port = std::stoi(argv[++i]);
+        } else if (arg == "--control" && i + 1 < argc) {
+            control_path = argv[++i];
+        } else if (arg == "--dashboard") {
+            use_dashboard = true;
+        } else if (arg == "--share-identical") {
+            share_identical = true;
+        } else if (arg == "--rollups") {
+            emit_rollups = true;
+        } else if (arg == "--tsdb" && i + 1 < argc) {
+            metrics_store = std::make_unique<tsdb::Store>(argv[++i]);
+            if (!metrics_store->prepare()) {
+                return 1;
+            }
+        } else {
+            std::cerr << "Unknown option: " << arg << std::endl;
+            return 1;
+        }
+    }
 
-    std::vector<Camera*> cameras;
-    std::vector<std::thread> threads;
+    // Ctrl+C and SIGTERM stop the cameras and close the outputs in order
+    shutdown_fd = ::eventfd(0, EFD_CLOEXEC);
+    if (shutdown_fd < 0) {
+        std::cerr << "Could not create the shutdown eventfd" << std::endl;
+        return 1;
+    }
+    struct sigaction shutdown_action{};
+    shutdown_action.sa_handler = on_shutdown_signal;
+    sigemptyset(&shutdown_action.sa_mask);
+    sigaction(SIGINT, &shutdown_action, nullptr);
+    sigaction(SIGTERM, &shutdown_action, nullptr);
 
     // Add camera URIs here or read from a file
     // Example: std::map<std::string, std::string> camera_uris = {
@@ -241,27 +1654,188 @@ int main(int argc, char* argv[]) {
     //     {"Camera2", "rtspt://localhost:8554/test2"}
     // };
 
+    if (stall_timeout_ns > 0) {
+        stall_watchdog = std::make_unique<StallWatchdog>();
+        stall_watchdog->start();
+    }
+
+    if (!mosaic_path.empty()) {
+        // The mosaic needs keyframes at least as often as it refreshes
+        int64_t mosaic_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(mosaic_every).count();
+        if (decode_every_ns == 0 || decode_every_ns > mosaic_ns) {
+            decode_every_ns = mosaic_ns;
+        }
+        mosaic_writer = std::make_unique<MosaicWriter>(mosaic_path, mosaic_every.count(), tile_width, tile_height);
+        mosaic_writer->start();
+    }
+
+    if (decode_every_ns > 0 || snapshot_port > 0) {
+        decode_pool = std::make_unique<DecodePool>(decode_workers, decode_workers * 16);
+        decode_pool->start();
+    }
+
+    if (console_estimator != Estimator::Tumbling || interval.count() % 1000 != 0) {
+        console_precision = 1;
+    }
+
+    for (const auto& [format, path, estimator] : outputs) {
+        auto writer = std::make_unique<StructuredWriter>(format, path, estimator, rotate_bytes, rotate_seconds);
+        if (!writer->start()) {
+            return 1;
+        }
+        if (path == "-") {
+            console_output = false;
+        }
+        structured_writers.push_back(std::move(writer));
+    }
+
+    if (use_dashboard) {
+        if (!console_output) {
+            std::cerr << "--dashboard needs stdout; write structured output to a file instead" << std::endl;
+            return 1;
+        }
+        // Started before the cameras so their log lines land in its log pane
+        dashboard = std::make_unique<Dashboard>(console_estimator, console_precision, request_shutdown);
+        if (!dashboard->start()) {
+            return 1;
+        }
+    }
+
     std::map<std::string, std::string> camera_uris = read_camera_uris("../cameras.txt");
+
+    // Leave slots for cameras added through the control socket
+    size_t shm_cameras = camera_uris.size() + (control_path.empty() ? 0 : 64);
+    if (!shm_name.empty() && !metrics_segment.open(shm_name, shm_cameras)) {
+        return 1;
+    }
     
+    if (!clip_dir.empty()) {
+        // Every camera with a session of its own gets an equal share of the budget
+        std::set<std::string> sessions;
+        for (const auto& entry : camera_uris) {
+            sessions.insert(share_identical ? entry.second : entry.first);
+        }
+        clip_arena = std::make_unique<ClipArena>(clip_memory_mb * 1024 * 1024, sessions.size());
+        clip_writer = std::make_unique<ClipWriter>(clip_dir, clip_mp4);
+        clip_writer->start();
+    }
+
+    if (relay_port > 0) {
+#ifdef HAVE_RTSP_SERVER
+        relay_server = std::make_unique<RelayServer>(relay_port);
+        if (!relay_server->start()) {
+            return 1;
+        }
+#else
+        std::cerr << "--relay needs check_fps built with gstreamer-rtsp-server-1.0" << std::endl;
+        return 1;
+#endif
+    }
+
+    std::map<std::string, std::string> session_of_uri;
     for (const auto& entry : camera_uris) {
-        Camera* camera = new Camera(entry.first, entry.second);
-        camera->start();
-        cameras.push_back(camera);
-        threads.emplace_back(&Camera::run, camera, interval); // Start camera run in a thread
+        if (share_identical) {
+            auto inserted = session_of_uri.emplace(entry.second, entry.first);
+            if (!inserted.second) {
+                std::cout << "Camera " << entry.first << " shares the session of " << inserted.first->second << std::endl;
+                shared_sessions[entry.first] = inserted.first->second;
+                continue;
+            }
+        }
+        add_camera(entry.first, entry.second, interval);
+    }
+
+    std::unique_ptr<SnapshotServer> snapshot_server;
+    if (snapshot_port > 0) {
+        snapshot_server = std::make_unique<SnapshotServer>(
+            snapshot_port,
+            [](const std::string& name, std::vector<uint8_t>& jpeg) {
+                std::shared_ptr<Camera> camera = find_camera(name);
+                return camera ? camera->snapshot_jpeg(jpeg) : 404;
+            },
+            [] {
+                std::vector<std::string> names;
+                {
+                    std::lock_guard<std::mutex> lock(cameras_mutex);
+                    for (const auto& entry : running_cameras) {
+                        names.push_back(entry.first);
+                    }
+                }
+                for (const auto& entry : shared_sessions) {
+                    names.push_back(entry.first);
+                }
+                std::sort(names.begin(), names.end());
+                return names;
+            });
+        if (!snapshot_server->start()) {
+            snapshot_server.reset();
+        }
+    }
+
+    std::unique_ptr<ControlServer> control_server;
+    if (!control_path.empty()) {
+        control_server = std::make_unique<ControlServer>(
+            control_path, [interval](const std::vector<std::string>& words) { return handle_control(words, interval); });
+        if (!control_server->start()) {
+            control_server.reset();
+        }
     }
 
     std::thread fps_thread(print_fps, interval); // Start the FPS printing thread
 
-    // Run the main thread for a fixed duration
-    std::this_thread::sleep_for(std::chrono::seconds(6000)); // Run for 6000 seconds
+    // Run the main thread for a fixed duration, or until Ctrl+C / q
+    pollfd shutdown_wait{shutdown_fd, POLLIN, 0};
+    while (::poll(&shutdown_wait, 1, 6000 * 1000) < 0 && errno == EINTR) {
+    }
+    std::cout << "Shutting down" << std::endl;
 
-    // Cleanup
-    for (auto& camera : cameras) {
-        camera->set_running(false); // Stop the camera thread
-        camera->stop(); // Stop the camera
-        delete camera; // Free the memory
+    // The last tick goes out before the outputs close, and the dashboard gives
+    // the terminal back so the rest of the shutdown log is visible
+    {
+        std::lock_guard<std::mutex> lock(print_mutex);
+        print_stopping = true;
+    }
+    print_wake.notify_one();
+    fps_thread.join();
+    if (dashboard) {
+        dashboard->stop();
     }
 
-    fps_thread.join(); // Wait for FPS thread to finish
+    // Cleanup; decode callbacks point at cameras, so the pool goes first
+    // (snapshot requests wait on the pool, so the server stops before it)
+    if (control_server) {
+        control_server->stop();
+    }
+    if (snapshot_server) {
+        snapshot_server->stop();
+    }
+#ifdef HAVE_RTSP_SERVER
+    // Relay mounts belong to the cameras
+    if (relay_server) {
+        relay_server->stop();
+    }
+#endif
+    if (decode_pool) {
+        decode_pool->stop();
+    }
+    for (auto& entry : running_cameras) {
+        entry.second.camera->set_running(false); // Stop the camera thread
+        entry.second.thread.join();
+        entry.second.camera->stop(); // Stop the camera
+    }
+    running_cameras.clear();
+
+    for (auto& writer : structured_writers) {
+        writer->stop();
+    }
+    if (metrics_store) {
+        metrics_store->close();
+    }
+    if (clip_writer) {
+        clip_writer->stop();
+    }
+    if (mosaic_writer) {
+        mosaic_writer->stop();
+    }
     return 0;
 }
@@ -0,0 +1,468 @@
+#pragma once
+// Pre-event recording: the last seconds of every camera's encoded access units
+// are kept in memory and written to an MP4 / Matroska clip when an anomaly
+// fires.
+//
+// All frames live in one arena allocated up front and handed out in 64 KiB
+// chunks, so the memory cap is fixed no matter how many cameras misbehave.
+// Each camera may hold at most its equal share of the chunks, which keeps one
+// high-bitrate camera from starving the others; the share follows cameras
+// added or removed at runtime. A ring only ever drops whole
+// GOPs from its front, so it always starts at a keyframe and a dumped clip is
+// playable from its first frame. Muxing runs on the ClipWriter's own thread.
+#include <gst/gst.h>
+#include <gst/app/gstappsrc.h>
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <ctime>
+#include <deque>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+class ClipArena {
+public:
+    static constexpr size_t kChunkSize = 64 * 1024;
+
+    // Pages are only touched once a chunk is first used
+    ClipArena(size_t budget_bytes, size_t cameras)
+        : chunk_count(std::max<size_t>(budget_bytes / kChunkSize, 1)),
+          share(std::max<size_t>(chunk_count / std::max<size_t>(cameras, 1), 1)),
+          memory(new uint8_t[chunk_count * kChunkSize]) {
+        free_chunks.reserve(chunk_count);
+        for (size_t i = chunk_count; i-- > 0;) {
+            free_chunks.push_back(memory.get() + i * kChunkSize);
+        }
+    }
+
+    // Chunks one camera may hold at a time
+    size_t per_camera_chunks() const { return share.load(std::memory_order_relaxed); }
+
+    // Rings above a smaller share shrink on their next frame
+    void set_cameras(size_t cameras) {
+        share.store(std::max<size_t>(chunk_count / std::max<size_t>(cameras, 1), 1), std::memory_order_relaxed);
+    }
+
+    uint8_t* allocate() {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (free_chunks.empty()) {
+            return nullptr;
+        }
+        uint8_t* chunk = free_chunks.back();
+        free_chunks.pop_back();
+        return chunk;
+    }
+
+    void release(uint8_t* chunk) {
+        std::lock_guard<std::mutex> lock(mutex);
+        free_chunks.push_back(chunk);
+    }
+
+private:
+    size_t chunk_count;
+    std::atomic<size_t> share;
+    std::unique_ptr<uint8_t[]> memory;
+    std::mutex mutex;
+    std::vector<uint8_t*> free_chunks;
+};
+
+struct ClipFrame {
+    uint64_t offset;      // Into the ring's logical byte stream, or into Clip::data once copied out
+    uint32_t size;
+    GstClockTime pts;
+    GstClockTime dts;
+    GstClockTime duration;
+    int64_t arrival_ns;
+    bool keyframe;
+};
+
+// A copy of one ring, owned by the writer until it is muxed
+struct Clip {
+    std::string camera;
+    std::string reason;
+    GstCaps* caps = nullptr;
+    std::vector<uint8_t> data;
+    std::vector<ClipFrame> frames;
+
+    ~Clip() {
+        if (caps) {
+            gst_caps_unref(caps);
+        }
+    }
+};
+
+// Frames are appended back to back into a chain of arena chunks, so a frame may
+// straddle two chunks. push() comes from the streaming thread, copy() from
+// run(); both take the ring's mutex, copy() only to pin the chunks it reads.
+class ClipRing {
+public:
+    ClipRing(ClipArena& arena, int64_t window_ns) : arena(arena), window_ns(window_ns) {}
+
+    ~ClipRing() {
+        clear();
+    }
+
+    // data / size are the caller's mapping of buffer, which supplies the timestamps
+    void push(GstCaps* caps, GstBuffer* buffer, const uint8_t* data, size_t size, bool keyframe, int64_t now_ns) {
+        if (!caps) {
+            return;
+        }
+        std::lock_guard<std::mutex> lock(mutex);
+        // Frames of different formats cannot share one file
+        if (!current_caps || !gst_caps_is_equal(caps, current_caps)) {
+            clear();
+            current_caps = gst_caps_ref(caps);
+        }
+        // Time window first: a GOP goes once the next one alone covers the window
+        while (true) {
+            int64_t next_gop_ns = second_gop_arrival();
+            if (next_gop_ns < 0 || next_gop_ns > now_ns - window_ns) {
+                break;
+            }
+            drop_gop();
+        }
+        if (frames.empty() && !keyframe) {
+            return;
+        }
+        // Making room may have dropped the GOP this frame belongs to
+        if (reserve(size) && (keyframe || !frames.empty())) {
+            write(data, size);
+            frames.push_back({write_offset - size, static_cast<uint32_t>(size), GST_BUFFER_PTS(buffer),
+                              GST_BUFFER_DTS(buffer), GST_BUFFER_DURATION(buffer), now_ns, keyframe});
+        }
+    }
+
+    // Copies the buffered GOPs out so the ring can keep recording; null if empty.
+    // Chunks dropped meanwhile are held back from the arena until the copy is done.
+    std::unique_ptr<Clip> copy(const std::string& camera, const std::string& reason) {
+        auto clip = std::make_unique<Clip>();
+        std::vector<uint8_t*> pinned;
+        uint64_t pinned_base;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (frames.empty()) {
+                return nullptr;
+            }
+            clip->caps = gst_caps_ref(current_caps);
+            clip->frames.assign(frames.begin(), frames.end());
+            pinned.assign(chunks.begin(), chunks.end());
+            pinned_base = base_offset;
+            ++readers;
+        }
+        clip->camera = camera;
+        clip->reason = reason;
+        clip->data.resize(clip->frames.back().offset + clip->frames.back().size - clip->frames.front().offset);
+        size_t position = 0;
+        for (ClipFrame& frame : clip->frames) {
+            read(pinned, pinned_base, frame.offset, frame.size, clip->data.data() + position);
+            frame.offset = position;
+            position += frame.size;
+        }
+        std::lock_guard<std::mutex> lock(mutex);
+        if (--readers == 0) {
+            for (uint8_t* chunk : held) {
+                arena.release(chunk);
+            }
+            held.clear();
+        }
+        return clip;
+    }
+
+private:
+    // Arrival of the second buffered GOP, -1 while there is only one
+    int64_t second_gop_arrival() const {
+        if (frames.size() < 2) {
+            return -1;
+        }
+        auto next = std::find_if(frames.begin() + 1, frames.end(), [](const ClipFrame& frame) { return frame.keyframe; });
+        return next != frames.end() ? next->arrival_ns : -1;
+    }
+
+    // Drops the oldest GOP and gives back every chunk no frame uses any more
+    void drop_gop() {
+        frames.pop_front();
+        while (!frames.empty() && !frames.front().keyframe) {
+            frames.pop_front();
+        }
+        if (frames.empty()) {
+            clear_chunks();
+            return;
+        }
+        uint64_t keep_from = frames.front().offset;
+        while (!chunks.empty() && base_offset + ClipArena::kChunkSize <= keep_from) {
+            release(chunks.front());
+            chunks.pop_front();
+            base_offset += ClipArena::kChunkSize;
+        }
+    }
+
+    // Makes room for size more bytes within the camera's share, dropping GOPs
+    // as needed; false if the frame cannot fit even in an empty ring
+    bool reserve(size_t size) {
+        size_t limit = arena.per_camera_chunks();
+        while (true) {
+            uint64_t needed = (write_offset + size - base_offset + ClipArena::kChunkSize - 1) / ClipArena::kChunkSize;
+            if (needed > limit) {
+                if (frames.empty()) {
+                    return false;
+                }
+                drop_gop();
+                continue;
+            }
+            while (chunks.size() < needed) {
+                uint8_t* chunk = arena.allocate();
+                if (!chunk) {
+                    break;
+                }
+                chunks.push_back(chunk);
+            }
+            if (chunks.size() >= needed) {
+                return true;
+            }
+            // Arena exhausted by other cameras still under their share
+            if (frames.empty()) {
+                return false;
+            }
+            drop_gop();
+        }
+    }
+
+    void write(const uint8_t* data, size_t size) {
+        while (size > 0) {
+            uint64_t position = write_offset - base_offset;
+            size_t in_chunk = position % ClipArena::kChunkSize;
+            size_t length = std::min(size, ClipArena::kChunkSize - in_chunk);
+            std::memcpy(chunks[position / ClipArena::kChunkSize] + in_chunk, data, length);
+            data += length;
+            size -= length;
+            write_offset += length;
+        }
+    }
+
+    static void read(const std::vector<uint8_t*>& pinned, uint64_t pinned_base, uint64_t offset, size_t size, uint8_t* out) {
+        while (size > 0) {
+            uint64_t position = offset - pinned_base;
+            size_t in_chunk = position % ClipArena::kChunkSize;
+            size_t length = std::min(size, ClipArena::kChunkSize - in_chunk);
+            std::memcpy(out, pinned[position / ClipArena::kChunkSize] + in_chunk, length);
+            out += length;
+            size -= length;
+            offset += length;
+        }
+    }
+
+    // A copy in progress may still read the chunk
+    void release(uint8_t* chunk) {
+        if (readers > 0) {
+            held.push_back(chunk);
+        } else {
+            arena.release(chunk);
+        }
+    }
+
+    // Restarts the logical stream at 0, chunk aligned
+    void clear_chunks() {
+        for (uint8_t* chunk : chunks) {
+            release(chunk);
+        }
+        chunks.clear();
+        base_offset = write_offset = 0;
+    }
+
+    void clear() {
+        frames.clear();
+        clear_chunks();
+        if (current_caps) {
+            gst_caps_unref(current_caps);
+            current_caps = nullptr;
+        }
+    }
+
+    ClipArena& arena;
+    int64_t window_ns;
+    std::mutex mutex;
+    GstCaps* current_caps = nullptr;
+    std::deque<uint8_t*> chunks;
+    std::deque<ClipFrame> frames;
+    uint64_t base_offset = 0;   // Logical offset of the first byte of chunks.front()
+    uint64_t write_offset = 0;  // Logical offset of the next byte
+    int readers = 0;  // copy() calls reading pinned chunks without the mutex
+    std::vector<uint8_t*> held;  // Dropped while readers > 0, released by the last one
+};
+
+// Muxes clips to <dir>/<camera>-<YYYYmmdd-HHMMSS>-<reason>.<mp4|mkv> one at a
+// time; clips beyond kMaxQueued are dropped rather than held in memory.
+class ClipWriter {
+public:
+    static constexpr size_t kMaxQueued = 4;
+
+    ClipWriter(const std::string& dir, bool mp4) : dir(dir), mp4(mp4) {}
+
+    ~ClipWriter() { stop(); }
+
+    void start() {
+        worker = std::thread(&ClipWriter::run, this);
+    }
+
+    // Clips still queued are written before the thread exits
+    void stop() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        cv.notify_one();
+        if (worker.joinable()) {
+            worker.join();
+        }
+    }
+
+    void submit(std::unique_ptr<Clip> clip) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (queue.size() >= kMaxQueued) {
+                std::cerr << "Clip queue full, dropping clip of camera: " << clip->camera << std::endl;
+                return;
+            }
+            queue.push_back(std::move(clip));
+        }
+        cv.notify_one();
+    }
+
+private:
+    void run() {
+        while (true) {
+            std::unique_ptr<Clip> clip;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                cv.wait(lock, [this] { return stopping || !queue.empty(); });
+                if (queue.empty()) {
+                    return;
+                }
+                clip = std::move(queue.front());
+                queue.pop_front();
+            }
+            std::string path = clip_path(*clip);
+            if (write(*clip, path)) {
+                std::cout << "Clip written for " << clip->camera << " (" << clip->reason << "): " << path << std::endl;
+            }
+        }
+    }
+
+    std::string clip_path(const Clip& clip) const {
+        std::time_t now = std::time(nullptr);
+        std::tm local;
+        localtime_r(&now, &local);
+        char stamp[32];
+        std::strftime(stamp, sizeof(stamp), "%Y%m%d-%H%M%S", &local);
+        return dir + "/" + clip.camera + "-" + stamp + "-" + clip.reason + (mp4 ? ".mp4" : ".mkv");
+    }
+
+    static const char* parser_for(GstCaps* caps) {
+        std::string media = gst_structure_get_name(gst_caps_get_structure(caps, 0));
+        if (media == "video/x-h264") {
+            return "h264parse";
+        } else if (media == "video/x-h265") {
+            return "h265parse";
+        } else if (media == "image/jpeg") {
+            return "jpegparse";
+        } else if (media == "video/mpeg") {
+            return "mpeg4videoparse";
+        }
+        return nullptr;
+    }
+
+    // Timestamps are rebased so the clip starts at zero; frames without any
+    // (some depayloaders leave DTS unset) fall back to their arrival time
+    static void set_timestamps(GstBuffer* buffer, const ClipFrame& frame, const ClipFrame& first) {
+        GstClockTime origin = GST_CLOCK_TIME_IS_VALID(first.dts) ? first.dts : first.pts;
+        auto rebase = [origin](GstClockTime time) {
+            return GST_CLOCK_TIME_IS_VALID(time) && GST_CLOCK_TIME_IS_VALID(origin)
+                       ? (time > origin ? time - origin : 0) : GST_CLOCK_TIME_NONE;
+        };
+        GST_BUFFER_PTS(buffer) = rebase(frame.pts);
+        GST_BUFFER_DTS(buffer) = rebase(frame.dts);
+        if (!GST_CLOCK_TIME_IS_VALID(GST_BUFFER_PTS(buffer)) && !GST_CLOCK_TIME_IS_VALID(GST_BUFFER_DTS(buffer))) {
+            GST_BUFFER_PTS(buffer) = static_cast<GstClockTime>(frame.arrival_ns - first.arrival_ns);
+        }
+        GST_BUFFER_DURATION(buffer) = frame.duration;
+    }
+
+    bool write(const Clip& clip, const std::string& path) {
+        const char* parser_name = parser_for(clip.caps);
+        if (!parser_name) {
+            std::cerr << "No parser to write clips of camera: " << clip.camera << std::endl;
+            return false;
+        }
+        GstElement* pipeline = gst_pipeline_new(NULL);
+        GstElement* appsrc = gst_element_factory_make("appsrc", NULL);
+        GstElement* parser = gst_element_factory_make(parser_name, NULL);
+        GstElement* mux = gst_element_factory_make(mp4 ? "mp4mux" : "matroskamux", NULL);
+        GstElement* sink = gst_element_factory_make("filesink", NULL);
+        if (!pipeline || !appsrc || !parser || !mux || !sink) {
+            std::cerr << "Failed to create clip pipeline for camera: " << clip.camera << std::endl;
+            for (GstElement* element : {pipeline, appsrc, parser, mux, sink}) {
+                if (element) {
+                    gst_object_unref(element);
+                }
+            }
+            return false;
+        }
+        g_object_set(appsrc, "caps", clip.caps, "format", GST_FORMAT_TIME, NULL);
+        g_object_set(sink, "location", path.c_str(), NULL);
+        gst_bin_add_many(GST_BIN(pipeline), appsrc, parser, mux, sink, NULL);
+
+        bool written = false;
+        if (gst_element_link_many(appsrc, parser, mux, sink, NULL)
+            && gst_element_set_state(pipeline, GST_STATE_PLAYING) != GST_STATE_CHANGE_FAILURE) {
+            for (const ClipFrame& frame : clip.frames) {
+                GstBuffer* buffer = gst_buffer_new_allocate(NULL, frame.size, NULL);
+                gst_buffer_fill(buffer, 0, clip.data.data() + frame.offset, frame.size);
+                set_timestamps(buffer, frame, clip.frames.front());
+                if (!frame.keyframe) {
+                    GST_BUFFER_FLAG_SET(buffer, GST_BUFFER_FLAG_DELTA_UNIT);
+                }
+                gst_app_src_push_buffer(GST_APP_SRC(appsrc), buffer);
+            }
+            gst_app_src_end_of_stream(GST_APP_SRC(appsrc));
+            // The muxer finalizes the file (MP4 moov atom) on EOS
+            GstBus* bus = gst_element_get_bus(pipeline);
+            GstMessage* msg = gst_bus_timed_pop_filtered(bus, 30 * GST_SECOND,
+                                                         static_cast<GstMessageType>(GST_MESSAGE_EOS | GST_MESSAGE_ERROR));
+            if (msg && GST_MESSAGE_TYPE(msg) == GST_MESSAGE_EOS) {
+                written = true;
+            } else if (msg) {
+                GError* err = nullptr;
+                gchar* debug_info = nullptr;
+                gst_message_parse_error(msg, &err, &debug_info);
+                std::cerr << "Clip write failed for camera " << clip.camera << ": " << err->message << std::endl;
+                g_error_free(err);
+                g_free(debug_info);
+            } else {
+                std::cerr << "Clip write timed out for camera: " << clip.camera << std::endl;
+            }
+            if (msg) {
+                gst_message_unref(msg);
+            }
+            gst_object_unref(bus);
+        } else {
+            std::cerr << "Failed to start clip pipeline for camera: " << clip.camera << std::endl;
+        }
+        gst_element_set_state(pipeline, GST_STATE_NULL);
+        gst_object_unref(pipeline);
+        return written;
+    }
+
+    std::string dir;
+    bool mp4;
+    std::mutex mutex;
+    std::condition_variable cv;
+    std::deque<std::unique_ptr<Clip>> queue;
+    bool stopping = false;
+    std::thread worker;
+};
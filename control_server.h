@@ -0,0 +1,230 @@
+#pragma once
+// Control socket for a running instance (--control <path>).
+//
+// A UNIX stream socket speaking one command per line; every response is one
+// or more lines starting with "OK" or "ERR", followed by an empty line. One
+// thread runs a poll() loop over the listening socket and all clients with
+// non-blocking I/O, and runs the commands itself, so commands are serialized
+// and never touch the streaming threads beyond the locks the commands take.
+//
+//   echo list | nc -U /tmp/check_fps.sock
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstring>
+#include <functional>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+class ControlServer {
+public:
+    // Gets the words of one command line and returns the full response text
+    using Handler = std::function<std::string(const std::vector<std::string>& words)>;
+
+    static constexpr size_t kMaxLine = 4096;
+    static constexpr size_t kMaxClients = 32;
+
+    ControlServer(const std::string& path, Handler handler) : path(path), handler(std::move(handler)) {}
+
+    ~ControlServer() { stop(); }
+
+    bool start() {
+        sockaddr_un address{};
+        if (path.size() >= sizeof(address.sun_path)) {
+            std::cerr << "Control socket path too long: " << path << std::endl;
+            return false;
+        }
+        listen_fd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        wake_fd = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        if (listen_fd < 0 || wake_fd < 0) {
+            std::cerr << "Could not create control socket: " << std::strerror(errno) << std::endl;
+            return false;
+        }
+        address.sun_family = AF_UNIX;
+        std::strncpy(address.sun_path, path.c_str(), sizeof(address.sun_path) - 1);
+        // A stale socket file from a previous run would make bind fail; one
+        // that still accepts connections belongs to a running instance
+        int probe = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (probe >= 0) {
+            bool live = ::connect(probe, reinterpret_cast<sockaddr*>(&address), sizeof(address)) == 0;
+            bool stale = !live && errno == ECONNREFUSED;
+            ::close(probe);
+            if (live) {
+                std::cerr << "Control socket " << path << " is in use by another instance" << std::endl;
+                return false;
+            }
+            if (stale) {
+                ::unlink(path.c_str());
+            }
+        }
+        if (::bind(listen_fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) < 0) {
+            std::cerr << "Could not bind control socket " << path << ": " << std::strerror(errno) << std::endl;
+            return false;
+        }
+        bound = true;
+        if (::listen(listen_fd, 8) < 0) {
+            std::cerr << "Could not listen on control socket " << path << ": " << std::strerror(errno) << std::endl;
+            return false;
+        }
+        // Only the owner may control the instance
+        ::chmod(path.c_str(), 0600);
+        std::cout << "Control socket listening at " << path << std::endl;
+        worker = std::thread(&ControlServer::run, this);
+        return true;
+    }
+
+    void stop() {
+        if (worker.joinable()) {
+            uint64_t one = 1;
+            ssize_t written = ::write(wake_fd, &one, sizeof(one));
+            (void)written;
+            worker.join();
+        }
+        for (auto& client : clients) {
+            ::close(client.first);
+        }
+        clients.clear();
+        if (listen_fd >= 0) {
+            ::close(listen_fd);
+            listen_fd = -1;
+        }
+        // Never remove a socket file this process did not create
+        if (bound) {
+            ::unlink(path.c_str());
+            bound = false;
+        }
+        if (wake_fd >= 0) {
+            ::close(wake_fd);
+            wake_fd = -1;
+        }
+    }
+
+private:
+    struct Client {
+        std::string input;
+        std::string output;
+    };
+
+    void run() {
+        std::vector<pollfd> fds;
+        while (true) {
+            fds.clear();
+            fds.push_back({wake_fd, POLLIN, 0});
+            fds.push_back({listen_fd, POLLIN, 0});
+            for (const auto& client : clients) {
+                fds.push_back({client.first, short(POLLIN | (client.second.output.empty() ? 0 : POLLOUT)), 0});
+            }
+            if (::poll(fds.data(), fds.size(), -1) < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                std::cerr << "Control socket poll failed: " << std::strerror(errno) << std::endl;
+                return;
+            }
+            if (fds[0].revents) {
+                return;
+            }
+            if (fds[1].revents & POLLIN) {
+                accept_clients();
+            }
+            for (size_t i = 2; i < fds.size(); ++i) {
+                if (fds[i].revents && !service(fds[i].fd, fds[i].revents)) {
+                    ::close(fds[i].fd);
+                    clients.erase(fds[i].fd);
+                }
+            }
+        }
+    }
+
+    void accept_clients() {
+        while (true) {
+            int fd = ::accept4(listen_fd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+            if (fd < 0) {
+                return;
+            }
+            if (clients.size() >= kMaxClients) {
+                ::close(fd);
+                continue;
+            }
+            clients[fd] = Client();
+        }
+    }
+
+    // Returns false when the client should be dropped
+    bool service(int fd, short revents) {
+        Client& client = clients[fd];
+        if (revents & POLLIN) {
+            char chunk[1024];
+            while (true) {
+                ssize_t received = ::recv(fd, chunk, sizeof(chunk), 0);
+                if (received > 0) {
+                    client.input.append(chunk, received);
+                    continue;
+                }
+                if (received == 0) {
+                    // Peer closed its side; still answer what it sent (echo cmd | nc -U)
+                    execute_lines(client);
+                    flush(fd, client);
+                    return false;
+                }
+                if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+                    return false;
+                }
+                break;
+            }
+            execute_lines(client);
+            if (client.input.size() > kMaxLine) {
+                client.output += "ERR line too long\n\n";
+                client.input.clear();
+            }
+        } else if (revents & (POLLERR | POLLHUP)) {
+            return false;
+        }
+        return flush(fd, client);
+    }
+
+    void execute_lines(Client& client) {
+        size_t newline;
+        while ((newline = client.input.find('\n')) != std::string::npos) {
+            std::istringstream line(client.input.substr(0, newline));
+            client.input.erase(0, newline + 1);
+            std::vector<std::string> words;
+            std::string word;
+            while (line >> word) {
+                words.push_back(word);
+            }
+            if (!words.empty()) {
+                client.output += handler(words) + "\n";
+            }
+        }
+    }
+
+    static bool flush(int fd, Client& client) {
+        while (!client.output.empty()) {
+            ssize_t sent = ::send(fd, client.output.data(), client.output.size(), MSG_NOSIGNAL | MSG_DONTWAIT);
+            if (sent > 0) {
+                client.output.erase(0, sent);
+            } else {
+                return sent < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR);
+            }
+        }
+        return true;
+    }
+
+    std::string path;
+    Handler handler;
+    int listen_fd = -1;
+    int wake_fd = -1;
+    bool bound = false;  // The socket file at path is ours
+    std::thread worker;
+    std::map<int, Client> clients;  // Control thread only
+};
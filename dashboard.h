@@ -0,0 +1,656 @@
+#pragma once
+// Full-screen terminal dashboard (--dashboard), replacing the one-line console
+// report: a table of every camera with FPS, bitrate, packet loss, state and an
+// FPS sparkline, sortable, filterable and scrollable from the keyboard.
+//
+// Each frame is drawn into a cell grid and compared with the grid the terminal
+// already shows; only cells that differ are sent, each run behind one cursor
+// move. A steady wall of cameras costs a few bytes per changed figure, however
+// many cameras there are or how short the interval is. Log lines printed while
+// the dashboard runs are captured and shown in a pane at the bottom. The quit
+// key only asks the owner to shut down; stop() gives the terminal back.
+#include "metrics_snapshot.h"
+#include <poll.h>
+#include <signal.h>
+#include <sys/eventfd.h>
+#include <sys/ioctl.h>
+#include <termios.h>
+#include <unistd.h>
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <deque>
+#include <functional>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <set>
+#include <streambuf>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace tui {
+
+enum Style : uint8_t { kNormal, kBold, kHeader, kAlert, kDim };
+
+struct Cell {
+    uint32_t ch = ' ';  // Unicode code point, always one column wide
+    uint8_t style = kNormal;
+
+    bool operator==(const Cell& other) const { return ch == other.ch && style == other.style; }
+};
+
+// What should be on the terminal (back) and what is (front)
+class Screen {
+public:
+    int height() const { return rows; }
+    int width() const { return cols; }
+
+    // Forgets what the terminal shows, so the next render draws every cell
+    void resize(int new_rows, int new_cols) {
+        rows = new_rows;
+        cols = new_cols;
+        back.assign(size_t(rows) * cols, Cell());
+        front.assign(back.size(), Cell{0, kNormal});
+    }
+
+    void clear() { std::fill(back.begin(), back.end(), Cell()); }
+
+    void put(int row, int col, uint32_t ch, uint8_t style) {
+        if (row >= 0 && row < rows && col >= 0 && col < cols) {
+            back[size_t(row) * cols + col] = Cell{ch, style};
+        }
+    }
+
+    // Writes text clipped to width columns (to the end of the row if negative),
+    // padding with spaces; bytes outside printable ASCII show as '?'
+    void put(int row, int col, const std::string& text, uint8_t style, int width = -1) {
+        if (width < 0) {
+            width = cols - col;
+        }
+        for (int i = 0; i < width; ++i) {
+            unsigned char ch = i < int(text.size()) ? text[i] : ' ';
+            put(row, col + i, ch >= 0x20 && ch < 0x7f ? ch : '?', style);
+        }
+    }
+
+    // Escape sequences that turn front into back
+    std::string render() {
+        std::string out;
+        int cursor_row = -1;
+        int cursor_col = -1;
+        int style = -1;
+        for (int row = 0; row < rows; ++row) {
+            for (int col = 0; col < cols; ++col) {
+                size_t i = size_t(row) * cols + col;
+                if (back[i] == front[i]) {
+                    continue;
+                }
+                if (row != cursor_row || col != cursor_col) {
+                    out += "\033[" + std::to_string(row + 1) + ";" + std::to_string(col + 1) + "H";
+                }
+                if (back[i].style != style) {
+                    style = back[i].style;
+                    out += sgr(back[i].style);
+                }
+                append_utf8(out, back[i].ch);
+                front[i] = back[i];
+                cursor_row = row;
+                cursor_col = col + 1;
+            }
+        }
+        if (style > kNormal) {
+            out += sgr(kNormal);
+        }
+        return out;
+    }
+
+private:
+    static const char* sgr(uint8_t style) {
+        switch (style) {
+            case kBold: return "\033[0;1m";
+            case kHeader: return "\033[0;7m";
+            case kAlert: return "\033[0;1;31m";
+            case kDim: return "\033[0;2m";
+            default: return "\033[0m";
+        }
+    }
+
+    static void append_utf8(std::string& out, uint32_t ch) {
+        if (ch < 0x80) {
+            out += char(ch);
+        } else if (ch < 0x800) {
+            out += char(0xc0 | (ch >> 6));
+            out += char(0x80 | (ch & 0x3f));
+        } else {
+            out += char(0xe0 | (ch >> 12));
+            out += char(0x80 | ((ch >> 6) & 0x3f));
+            out += char(0x80 | (ch & 0x3f));
+        }
+    }
+
+    int rows = 0;
+    int cols = 0;
+    std::vector<Cell> back;
+    std::vector<Cell> front;
+};
+
+// Stands in for std::cout / std::cerr while the dashboard owns the terminal.
+// Unbuffered, so every write from any thread comes through the mutex.
+class LogCapture : public std::streambuf {
+public:
+    static constexpr size_t kMaxLines = 100;
+
+    explicit LogCapture(std::function<void()> on_line) : on_line(std::move(on_line)) {}
+
+    std::vector<std::string> tail(size_t count) {
+        std::lock_guard<std::mutex> lock(mutex);
+        size_t first = lines.size() > count ? lines.size() - count : 0;
+        return std::vector<std::string>(lines.begin() + first, lines.end());
+    }
+
+protected:
+    int overflow(int ch) override {
+        if (ch != traits_type::eof()) {
+            char c = static_cast<char>(ch);
+            xsputn(&c, 1);
+        }
+        return ch;
+    }
+
+    std::streamsize xsputn(const char* text, std::streamsize count) override {
+        bool line_done = false;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            for (std::streamsize i = 0; i < count; ++i) {
+                char ch = text[i];
+                // Color codes of the console output would show up as garbage
+                if (in_escape) {
+                    in_escape = !std::isalpha(static_cast<unsigned char>(ch));
+                } else if (ch == '\033') {
+                    in_escape = true;
+                } else if (ch == '\n') {
+                    lines.push_back(std::move(partial));
+                    partial.clear();
+                    if (lines.size() > kMaxLines) {
+                        lines.pop_front();
+                    }
+                    line_done = true;
+                } else if (ch != '\r') {
+                    partial += ch;
+                }
+            }
+        }
+        if (line_done) {
+            on_line();
+        }
+        return count;
+    }
+
+private:
+    std::function<void()> on_line;
+    std::mutex mutex;
+    std::deque<std::string> lines;
+    std::string partial;
+    bool in_escape = false;
+};
+
+} // namespace tui
+
+class Dashboard {
+public:
+    static constexpr size_t kHistory = 256;  // FPS samples kept per camera for the sparkline
+    static constexpr int kLogLines = 4;
+
+    // on_quit runs on the dashboard thread when q is pressed
+    Dashboard(Estimator estimator, int precision, std::function<void()> on_quit)
+        : estimator(estimator), precision(precision), on_quit(std::move(on_quit)), logs([this] { wake(); }) {}
+
+    ~Dashboard() { stop(); }
+
+    bool start() {
+        if (!::isatty(STDIN_FILENO) || !::isatty(STDOUT_FILENO)) {
+            std::cerr << "--dashboard needs a terminal on stdin and stdout" << std::endl;
+            return false;
+        }
+        wake_fd = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        if (wake_fd < 0 || ::tcgetattr(STDIN_FILENO, &saved_termios) < 0) {
+            std::cerr << "Could not set up the dashboard terminal" << std::endl;
+            return false;
+        }
+        // Keys arrive one by one without echo; Ctrl+C still raises SIGINT
+        termios raw = saved_termios;
+        raw.c_lflag &= ~(ICANON | ECHO);
+        raw.c_cc[VMIN] = 1;
+        raw.c_cc[VTIME] = 0;
+        ::tcsetattr(STDIN_FILENO, TCSANOW, &raw);
+        signal_wake_fd = wake_fd;
+        terminal_active = true;
+        struct sigaction action{};
+        action.sa_handler = &Dashboard::on_signal;
+        sigemptyset(&action.sa_mask);
+        ::sigaction(SIGWINCH, &action, nullptr);
+        write_all(kEnter);
+        saved_cout = std::cout.rdbuf(&logs);
+        saved_cerr = std::cerr.rdbuf(&logs);
+        worker = std::thread(&Dashboard::run, this);
+        return true;
+    }
+
+    void stop() {
+        if (!worker.joinable()) {
+            return;
+        }
+        stopping = true;
+        wake();
+        worker.join();
+        std::cout.rdbuf(saved_cout);
+        std::cerr.rdbuf(saved_cerr);
+        restore_terminal();
+        signal_wake_fd = -1;
+        ::close(wake_fd);
+        wake_fd = -1;
+    }
+
+    // Async-signal-safe (write() and tcsetattr() only), for a process that
+    // exits without stop()
+    static void restore_terminal() {
+        if (terminal_active.exchange(false)) {
+            ssize_t written = ::write(STDOUT_FILENO, kLeave, std::strlen(kLeave));
+            (void)written;
+            ::tcsetattr(STDIN_FILENO, TCSANOW, &saved_termios);
+        }
+    }
+
+    void submit(SnapshotPtr snapshot) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            pending = std::move(snapshot);  // A slow terminal just skips a frame
+        }
+        wake();
+    }
+
+private:
+    enum Column { kName, kFps, kBitrate, kLoss, kState, kColumns };
+
+    static constexpr const char* kEnter = "\033[?1049h\033[?25l";  // Alternate screen, hidden cursor
+    static constexpr const char* kLeave = "\033[0m\033[?25h\033[?1049l";
+
+    // Terminal state restore_terminal() puts back, also from a signal handler
+    static inline termios saved_termios;
+    static inline std::atomic<bool> terminal_active{false};
+    static inline std::atomic<int> signal_wake_fd{-1};
+
+    static void write_all(const std::string& text) {
+        size_t done = 0;
+        while (done < text.size()) {
+            ssize_t written = ::write(STDOUT_FILENO, text.data() + done, text.size() - done);
+            if (written < 0 && errno == EINTR) {
+                continue;
+            }
+            if (written <= 0) {
+                return;
+            }
+            done += written;
+        }
+    }
+
+    // SIGWINCH: redraw at the new size
+    static void on_signal(int) {
+        int fd = signal_wake_fd;
+        if (fd >= 0) {
+            uint64_t one = 1;
+            ssize_t written = ::write(fd, &one, sizeof(one));
+            (void)written;
+        }
+    }
+
+    void wake() {
+        if (wake_fd >= 0) {
+            uint64_t one = 1;
+            ssize_t written = ::write(wake_fd, &one, sizeof(one));
+            (void)written;
+        }
+    }
+
+    void run() {
+        bool keyboard = true;
+        while (!stopping) {
+            pollfd fds[2] = {{wake_fd, POLLIN, 0}, {STDIN_FILENO, short(keyboard ? POLLIN : 0), 0}};
+            if (::poll(fds, 2, -1) < 0 && errno != EINTR) {
+                return;
+            }
+            if (fds[0].revents & POLLIN) {
+                uint64_t count;
+                ssize_t got = ::read(wake_fd, &count, sizeof(count));
+                (void)got;
+            }
+            if (fds[1].revents & POLLIN) {
+                char keys[64];
+                ssize_t got = ::read(STDIN_FILENO, keys, sizeof(keys));
+                if (got > 0) {
+                    handle_keys(keys, got);
+                } else {
+                    keyboard = false;
+                }
+            } else if (fds[1].revents & (POLLHUP | POLLERR)) {
+                keyboard = false;
+            }
+            SnapshotPtr snapshot;
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                snapshot.swap(pending);
+            }
+            if (snapshot) {
+                add_to_history(*snapshot);
+                current = std::move(snapshot);
+            }
+            draw();
+        }
+    }
+
+    void add_to_history(const MetricsSnapshot& snapshot) {
+        std::set<std::string> present;
+        for (const auto& camera : snapshot.cameras) {
+            std::deque<float>& values = history[camera.name];
+            values.push_back(static_cast<float>(estimate(camera, estimator)));
+            if (values.size() > kHistory) {
+                values.pop_front();
+            }
+            present.insert(camera.name);
+        }
+        // Removed cameras
+        for (auto it = history.begin(); it != history.end();) {
+            it = present.count(it->first) ? std::next(it) : history.erase(it);
+        }
+    }
+
+    void handle_keys(const char* keys, ssize_t count) {
+        for (ssize_t i = 0; i < count; ++i) {
+            char key = keys[i];
+            if (key == '\033') {
+                // Arrow and paging keys: ESC [ A, ESC [ 5 ~, ...; a lone ESC cancels the filter
+                std::string sequence;
+                while (i + 1 < count && sequence.size() < 4) {
+                    sequence += keys[++i];
+                    if (sequence.size() > 1 && (std::isalpha(static_cast<unsigned char>(sequence.back())) || sequence.back() == '~')) {
+                        break;
+                    }
+                }
+                if (sequence.empty()) {
+                    editing_filter = false;
+                    filter.clear();
+                } else if (sequence == "[A") {
+                    scroll -= 1;
+                } else if (sequence == "[B") {
+                    scroll += 1;
+                } else if (sequence == "[5~") {
+                    scroll -= page_rows;
+                } else if (sequence == "[6~") {
+                    scroll += page_rows;
+                } else if (sequence == "[H") {
+                    scroll = 0;
+                } else if (sequence == "[F") {
+                    scroll = 1 << 30;
+                }
+            } else if (editing_filter) {
+                if (key == '\n' || key == '\r') {
+                    editing_filter = false;
+                } else if (key == 127 || key == '\b') {
+                    if (!filter.empty()) {
+                        filter.pop_back();
+                    }
+                } else if (key >= 0x20 && key < 0x7f) {
+                    filter += key;
+                }
+                scroll = 0;
+            } else if (key >= '1' && key < '1' + kColumns) {
+                // Picking the sorted column again reverses it
+                Column column = Column(key - '1');
+                descending = column == sort_column ? !descending : false;
+                sort_column = column;
+            } else if (key == '/') {
+                editing_filter = true;
+            } else if (key == 'a') {
+                alerts_only = !alerts_only;
+                scroll = 0;
+            } else if (key == 'k') {
+                scroll -= 1;
+            } else if (key == 'j') {
+                scroll += 1;
+            } else if (key == 'g') {
+                scroll = 0;
+            } else if (key == 'G') {
+                scroll = 1 << 30;
+            } else if (key == 'q') {
+                on_quit();
+            }
+        }
+    }
+
+    // 0 when healthy; higher is worse, and sorts first
+    int severity(const CameraSample& camera, std::string& state) const {
+        if (camera.stalled) {
+            state = "stalled";
+            return 5;
+        }
+        if (camera.frozen) {
+            state = "frozen";
+            return 4;
+        }
+        if (camera.image.valid && camera.image.state != "ok") {
+            state = camera.image.state;
+            return 3;
+        }
+        if (camera.scene.moved) {
+            state = "moved";
+            return 2;
+        }
+        if (estimate(camera, estimator) < 5) {
+            state = "low fps";
+            return 1;
+        }
+        state = "ok";
+        return 0;
+    }
+
+    struct Row {
+        const CameraSample* camera;
+        double fps;
+        std::string state;
+        int severity;
+    };
+
+    void draw() {
+        winsize size{};
+        if (::ioctl(STDOUT_FILENO, TIOCGWINSZ, &size) < 0 || size.ws_row == 0 || size.ws_col == 0) {
+            size.ws_row = 24;
+            size.ws_col = 80;
+        }
+        if (size.ws_row != screen.height() || size.ws_col != screen.width()) {
+            screen.resize(size.ws_row, size.ws_col);
+            write_all("\033[2J");
+        }
+        screen.clear();
+        int height = screen.height();
+        int width = screen.width();
+
+        std::vector<Row> rows;
+        int alerts = 0;
+        size_t name_width = 4;
+        if (current) {
+            rows.reserve(current->cameras.size());
+            for (const auto& camera : current->cameras) {
+                Row row{&camera, estimate(camera, estimator), "", 0};
+                row.severity = severity(camera, row.state);
+                alerts += row.severity > 0;
+                if ((alerts_only && row.severity == 0) || camera.name.find(filter) == std::string::npos) {
+                    continue;
+                }
+                name_width = std::max(name_width, camera.name.size());
+                rows.push_back(std::move(row));
+            }
+            sort_rows(rows);
+        }
+
+        // Title line
+        char title[256];
+        std::string clock = "--";
+        if (current) {
+            std::time_t now = current->timestamp_ms / 1000;
+            char text[32];
+            std::strftime(text, sizeof(text), "%d:%m:%Y %H:%M:%S", std::localtime(&now));
+            clock = text;
+        }
+        std::snprintf(title, sizeof(title), " check_fps  %s  %zu cameras  %d alerts%s%s%s", clock.c_str(),
+                      current ? current->cameras.size() : size_t(0), alerts, alerts_only ? "  [alerts only]" : "",
+                      filter.empty() ? "" : "  filter: ", filter.c_str());
+        screen.put(0, 0, title, tui::kBold);
+
+        // Column headers; the sorted one carries an arrow
+        int name_w = static_cast<int>(std::min<size_t>(name_width, 24));
+        const int widths[kColumns] = {name_w, 8, 9, 7, 12};
+        const char* names[kColumns] = {"NAME", "FPS", "KBPS", "LOSS%", "STATE"};
+        screen.put(1, 0, "", tui::kHeader);
+        int col = 1;
+        for (int c = 0; c < kColumns; ++c) {
+            std::string label = names[c];
+            bool right = c != kName && c != kState;
+            if (right) {
+                label = std::string(std::max<int>(0, widths[c] - int(label.size()) - 1), ' ') + label;
+            }
+            screen.put(1, col, label, tui::kHeader, widths[c]);
+            if (c == sort_column) {
+                int arrow = col + std::min<int>(int(label.size()), widths[c] - 1);
+                screen.put(1, arrow, descending ? 0x2193 : 0x2191, tui::kHeader);
+            }
+            col += widths[c] + 1;
+        }
+        int spark_col = col;
+        int spark_width = width - spark_col - 1;
+        screen.put(1, spark_col, "HISTORY", tui::kHeader, std::max(0, spark_width));
+
+        // Camera rows between the headers and the log pane
+        int log_lines = height >= 12 ? kLogLines : 0;
+        int first_row = 2;
+        page_rows = std::max(1, height - first_row - log_lines - 1);
+        int max_scroll = std::max(0, int(rows.size()) - page_rows);
+        scroll = std::clamp(scroll, 0, max_scroll);
+        if (!current) {
+            screen.put(first_row, 1, "Waiting for the first interval...", tui::kDim);
+        }
+        for (int r = 0; r < page_rows && scroll + r < int(rows.size()); ++r) {
+            const Row& row = rows[scroll + r];
+            draw_row(first_row + r, row, widths, spark_col, spark_width);
+        }
+
+        std::vector<std::string> lines = logs.tail(log_lines);
+        for (int i = 0; i < int(lines.size()); ++i) {
+            screen.put(height - 1 - log_lines + i, 1, lines[i], tui::kDim, width - 1);
+        }
+
+        std::string footer;
+        if (editing_filter) {
+            footer = " filter: " + filter + "_   (Enter keeps it, Esc clears it)";
+        } else {
+            char range[64];
+            std::snprintf(range, sizeof(range), "  %d-%d of %zu", rows.empty() ? 0 : scroll + 1,
+                          std::min<int>(scroll + page_rows, int(rows.size())), rows.size());
+            footer = " 1-5 sort  / filter  a alerts only  j/k PgUp/PgDn scroll  q quit" + std::string(range);
+        }
+        screen.put(height - 1, 0, footer, tui::kHeader);
+
+        write_all(screen.render());
+    }
+
+    void sort_rows(std::vector<Row>& rows) const {
+        auto key_less = [this](const Row& a, const Row& b) {
+            switch (sort_column) {
+                case kFps: return a.fps < b.fps;
+                case kBitrate: return a.camera->bitrate_kbps < b.camera->bitrate_kbps;
+                case kLoss: return a.camera->rtp.loss_pct() < b.camera->rtp.loss_pct();
+                case kState: return a.severity > b.severity;
+                default: return false;
+            }
+        };
+        // Ties, and the name column itself, go by name
+        std::sort(rows.begin(), rows.end(), [&](const Row& a, const Row& b) {
+            const Row& x = descending ? b : a;
+            const Row& y = descending ? a : b;
+            if (key_less(x, y)) {
+                return true;
+            }
+            if (key_less(y, x)) {
+                return false;
+            }
+            return x.camera->name < y.camera->name;
+        });
+    }
+
+    void draw_row(int line, const Row& row, const int* widths, int spark_col, int spark_width) {
+        const CameraSample& camera = *row.camera;
+        char text[32];
+        int col = 1;
+        screen.put(line, col, camera.name, tui::kNormal, widths[kName]);
+        col += widths[kName] + 1;
+        std::snprintf(text, sizeof(text), "%*.*f", widths[kFps] - 1, precision, row.fps);
+        screen.put(line, col, text, row.fps < 5 ? tui::kAlert : tui::kNormal, widths[kFps]);
+        col += widths[kFps] + 1;
+        std::snprintf(text, sizeof(text), "%*.0f", widths[kBitrate] - 1, camera.bitrate_kbps);
+        screen.put(line, col, text, tui::kNormal, widths[kBitrate]);
+        col += widths[kBitrate] + 1;
+        std::snprintf(text, sizeof(text), "%*.1f", widths[kLoss] - 1, camera.rtp.loss_pct());
+        screen.put(line, col, text, camera.rtp.lost > 0 ? tui::kAlert : tui::kNormal, widths[kLoss]);
+        col += widths[kLoss] + 1;
+        screen.put(line, col, row.state, row.severity ? tui::kAlert : tui::kNormal, widths[kState]);
+
+        // Newest sample on the right, scaled to the largest one shown
+        auto found = history.find(camera.name);
+        if (found == history.end() || spark_width <= 0) {
+            return;
+        }
+        const std::deque<float>& values = found->second;
+        size_t shown = std::min<size_t>(values.size(), spark_width);
+        float top = 0;
+        for (size_t i = values.size() - shown; i < values.size(); ++i) {
+            top = std::max(top, values[i]);
+        }
+        int start = spark_col + spark_width - static_cast<int>(shown);
+        for (size_t i = 0; i < shown; ++i) {
+            float value = values[values.size() - shown + i];
+            uint32_t ch = ' ';  // No frames at all stands out as a gap
+            if (value > 0 && top > 0) {
+                ch = 0x2581 + std::clamp(static_cast<int>(value / top * 8), 1, 8) - 1;
+            }
+            screen.put(line, start + static_cast<int>(i), ch, value < 5 ? tui::kAlert : tui::kNormal);
+        }
+    }
+
+    Estimator estimator;
+    int precision;
+    std::function<void()> on_quit;
+    tui::LogCapture logs;
+    std::streambuf* saved_cout = nullptr;
+    std::streambuf* saved_cerr = nullptr;
+    int wake_fd = -1;
+    std::atomic<bool> stopping{false};
+    std::thread worker;
+    std::mutex mutex;  // Protects pending
+    SnapshotPtr pending;
+    // Dashboard thread only from here on
+    SnapshotPtr current;
+    std::map<std::string, std::deque<float>> history;
+    tui::Screen screen;
+    Column sort_column = kName;
+    bool descending = false;
+    bool alerts_only = false;
+    bool editing_filter = false;
+    std::string filter;
+    int scroll = 0;
+    int page_rows = 1;
+};
@@ -0,0 +1,295 @@
+#pragma once
+// Shared pool of software decoders for sampled keyframes.
+//
+// Cameras hand in one keyframe now and then (see --decode-every); a fixed
+// number of worker threads decode them one at a time. Each worker keeps one
+// appsrc ! avdec_* ! videoconvert ! appsink pipeline limited to one decoder
+// thread and rebuilds it only when a job's caps differ from the last one, so
+// total decode CPU is bounded by the worker count no matter how many cameras
+// there are. A keyframe is pushed with EOS to drain the decoder, then a flush
+// resets the pipeline for the next one. The luma plane of the result is
+// handed back through a callback on the worker thread.
+#include "metrics_snapshot.h"
+#include <gst/gst.h>
+#include <gst/app/gstappsrc.h>
+#include <gst/app/gstappsink.h>
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+class DecodePool {
+public:
+    // Called on a worker thread; the frame is null when decoding failed
+    using Callback = std::function<void(DecodedFramePtr)>;
+
+    DecodePool(size_t workers, size_t max_queued) : worker_count(workers), max_queued(max_queued) {}
+
+    ~DecodePool() { stop(); }
+
+    void start() {
+        for (size_t i = 0; i < worker_count; ++i) {
+            workers.emplace_back(&DecodePool::run, this);
+        }
+    }
+
+    // Pending jobs are dropped; their callbacks are not called
+    void stop() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+            for (auto& job : queue) {
+                release(job);
+            }
+            queue.clear();
+        }
+        cv.notify_all();
+        for (auto& worker : workers) {
+            if (worker.joinable()) {
+                worker.join();
+            }
+        }
+        workers.clear();
+    }
+
+    // Drops the camera's queued jobs without calling their callbacks and waits
+    // for one that is being decoded, so the callback target can go away
+    void cancel(const std::string& camera) {
+        std::unique_lock<std::mutex> lock(mutex);
+        for (auto it = queue.begin(); it != queue.end();) {
+            if (it->camera == camera) {
+                release(*it);
+                it = queue.erase(it);
+            } else {
+                ++it;
+            }
+        }
+        finished.wait(lock, [&] { return busy.count(camera) == 0; });
+    }
+
+    // Takes its own references to caps and buffer. Returns false when the queue
+    // is full, so the caller can simply try again with a later keyframe.
+    bool submit(const std::string& camera, GstCaps* caps, GstBuffer* keyframe, Callback done) {
+        int64_t now_ms = std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::system_clock::now().time_since_epoch()).count();
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (stopping || queue.size() >= max_queued) {
+                return false;
+            }
+            queue.push_back({camera, now_ms, gst_caps_ref(caps), gst_buffer_ref(keyframe), std::move(done)});
+        }
+        cv.notify_one();
+        return true;
+    }
+
+private:
+    struct Job {
+        std::string camera;
+        int64_t timestamp_ms;
+        GstCaps* caps;
+        GstBuffer* buffer;
+        Callback done;
+    };
+
+    // A worker's pipeline; appsrc and appsink are owned by it
+    struct Decoder {
+        GstCaps* caps = nullptr;
+        GstElement* pipeline = nullptr;
+        GstElement* appsrc = nullptr;
+        GstElement* appsink = nullptr;
+    };
+
+    static void release(Job& job) {
+        if (job.caps) {
+            gst_caps_unref(job.caps);
+        }
+        if (job.buffer) {
+            gst_buffer_unref(job.buffer);
+        }
+    }
+
+    void run() {
+        Decoder decoder;
+        while (true) {
+            Job job;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                cv.wait(lock, [this] { return stopping || !queue.empty(); });
+                if (stopping) {
+                    destroy(decoder);
+                    return;
+                }
+                job = std::move(queue.front());
+                queue.pop_front();
+                busy.insert(job.camera);
+            }
+            DecodedFramePtr frame = decode(job, decoder);
+            release(job);
+            if (job.done) {
+                job.done(frame);
+            }
+            // The callback may own the last reference to what cancel() waits on
+            job.done = nullptr;
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                busy.erase(busy.find(job.camera));
+            }
+            finished.notify_all();
+        }
+    }
+
+    static const char* decoder_for(GstCaps* caps) {
+        std::string media = gst_structure_get_name(gst_caps_get_structure(caps, 0));
+        gint mpegversion = 0;
+        if (media == "video/x-h264") {
+            return "avdec_h264";
+        } else if (media == "video/x-h265") {
+            return "avdec_h265";
+        } else if (media == "image/jpeg") {
+            return "avdec_mjpeg";
+        } else if (media == "video/mpeg" && gst_structure_get_int(gst_caps_get_structure(caps, 0), "mpegversion", &mpegversion)
+                   && mpegversion == 4) {
+            return "avdec_mpeg4";
+        }
+        return nullptr;
+    }
+
+    static void destroy(Decoder& decoder) {
+        if (decoder.pipeline) {
+            gst_element_set_state(decoder.pipeline, GST_STATE_NULL);
+            gst_object_unref(decoder.pipeline);
+        }
+        if (decoder.caps) {
+            gst_caps_unref(decoder.caps);
+        }
+        decoder = Decoder();
+    }
+
+    static bool build(Decoder& target, const Job& job, const char* decoder_name) {
+        GstElement* pipeline = gst_pipeline_new(NULL);
+        GstElement* appsrc = gst_element_factory_make("appsrc", NULL);
+        GstElement* decoder = gst_element_factory_make(decoder_name, NULL);
+        GstElement* convert = gst_element_factory_make("videoconvert", NULL);
+        GstElement* appsink = gst_element_factory_make("appsink", NULL);
+        if (!pipeline || !appsrc || !decoder || !convert || !appsink) {
+            std::cerr << "Failed to create decode pipeline with " << decoder_name << " for camera: " << job.camera << std::endl;
+            for (GstElement* element : {pipeline, appsrc, decoder, convert, appsink}) {
+                if (element) {
+                    gst_object_unref(element);
+                }
+            }
+            return false;
+        }
+
+        GstCaps* gray = gst_caps_new_simple("video/x-raw", "format", G_TYPE_STRING, "GRAY8", NULL);
+        g_object_set(appsrc, "caps", job.caps, "format", GST_FORMAT_TIME, NULL);
+        g_object_set(decoder, "max-threads", 1, NULL);
+        g_object_set(appsink, "caps", gray, "sync", FALSE, NULL);
+        gst_caps_unref(gray);
+        gst_bin_add_many(GST_BIN(pipeline), appsrc, decoder, convert, appsink, NULL);
+
+        // Nobody watches this bus; a long-lived pipeline would queue every EOS on it
+        GstBus* bus = gst_element_get_bus(pipeline);
+        gst_bus_set_flushing(bus, TRUE);
+        gst_object_unref(bus);
+        if (!gst_element_link_many(appsrc, decoder, convert, appsink, NULL)
+            || gst_element_set_state(pipeline, GST_STATE_PLAYING) == GST_STATE_CHANGE_FAILURE) {
+            std::cerr << "Failed to start decode pipeline with " << decoder_name << " for camera: " << job.camera << std::endl;
+            gst_element_set_state(pipeline, GST_STATE_NULL);
+            gst_object_unref(pipeline);
+            return false;
+        }
+        target.caps = gst_caps_ref(job.caps);
+        target.pipeline = pipeline;
+        target.appsrc = appsrc;
+        target.appsink = appsink;
+        return true;
+    }
+
+    DecodedFramePtr decode(Job& job, Decoder& decoder) {
+        if (gst_caps_get_size(job.caps) == 0) {
+            return nullptr;
+        }
+        const char* decoder_name = decoder_for(job.caps);
+        if (!decoder_name) {
+            return nullptr;
+        }
+        auto started = std::chrono::steady_clock::now();
+
+        if (!decoder.pipeline || !gst_caps_is_equal(decoder.caps, job.caps)) {
+            destroy(decoder);
+            if (!build(decoder, job, decoder_name)) {
+                return nullptr;
+            }
+        }
+
+        // push_buffer takes the reference, the job keeps its own
+        DecodedFramePtr result;
+        gst_app_src_push_buffer(GST_APP_SRC(decoder.appsrc), gst_buffer_ref(job.buffer));
+        gst_app_src_end_of_stream(GST_APP_SRC(decoder.appsrc));
+        GstSample* sample = gst_app_sink_try_pull_sample(GST_APP_SINK(decoder.appsink), 2 * GST_SECOND);
+        if (sample) {
+            result = copy_luma(job, sample, started);
+            gst_sample_unref(sample);
+        }
+        if (!result) {
+            // Start from a fresh pipeline rather than trust one in an unknown state
+            std::cerr << "Keyframe decode failed for camera: " << job.camera << std::endl;
+            destroy(decoder);
+            return nullptr;
+        }
+        // Clears EOS in every element and resets the decoder for the next keyframe
+        gst_element_send_event(decoder.appsrc, gst_event_new_flush_start());
+        gst_element_send_event(decoder.appsrc, gst_event_new_flush_stop(TRUE));
+        return result;
+    }
+
+    static DecodedFramePtr copy_luma(const Job& job, GstSample* sample, std::chrono::steady_clock::time_point started) {
+        GstStructure* s = gst_caps_get_structure(gst_sample_get_caps(sample), 0);
+        auto frame = std::make_shared<DecodedFrame>();
+        if (!gst_structure_get_int(s, "width", &frame->width) || !gst_structure_get_int(s, "height", &frame->height)
+            || frame->width <= 0 || frame->height <= 0) {
+            return nullptr;
+        }
+        GstBuffer* buffer = gst_sample_get_buffer(sample);
+        GstMapInfo map;
+        if (!buffer || !gst_buffer_map(buffer, &map, GST_MAP_READ)) {
+            return nullptr;
+        }
+        // GRAY8 rows are padded to a multiple of 4 bytes
+        size_t stride = (frame->width + 3) & ~size_t(3);
+        if (map.size >= stride * (frame->height - 1) + frame->width) {
+            frame->luma.resize(size_t(frame->width) * frame->height);
+            for (int y = 0; y < frame->height; ++y) {
+                std::memcpy(&frame->luma[size_t(y) * frame->width], map.data + y * stride, frame->width);
+            }
+        }
+        gst_buffer_unmap(buffer, &map);
+        if (frame->luma.empty()) {
+            return nullptr;
+        }
+        frame->camera = job.camera;
+        frame->timestamp_ms = job.timestamp_ms;
+        frame->decode_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - started).count();
+        return frame;
+    }
+
+    size_t worker_count;
+    size_t max_queued;
+    std::mutex mutex;
+    std::condition_variable cv;
+    std::condition_variable finished;  // A job's callback returned, see cancel()
+    std::deque<Job> queue;
+    std::multiset<std::string> busy;  // Cameras of the jobs being decoded
+    bool stopping = false;
+    std::vector<std::thread> workers;
+};
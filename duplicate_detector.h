@@ -0,0 +1,79 @@
+#pragma once
+// Cross-camera duplicate stream detection.
+//
+// Two sessions of the same physical feed deliver the same encoded keyframes,
+// whatever URL they were opened with. Every camera keeps the payload hashes of
+// its last few keyframes (the CRC32C the frozen detector computes anyway), and
+// cameras sharing at least two distinct hashes are grouped as duplicates. A
+// single shared hash is not enough: two black or frozen cameras on identical
+// encoders can repeat one keyframe, but not a sequence of different ones.
+#include "metrics_snapshot.h"
+#include <algorithm>
+#include <cstdint>
+#include <map>
+#include <numeric>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace duplicates {
+
+constexpr size_t kKeyframeHashes = 8;      // Per camera, newest last
+constexpr int kMinSharedKeyframes = 2;
+
+// Groups of two or more camera names, each sorted, in order of their first name
+inline std::vector<std::vector<std::string>> find_groups(const std::vector<CameraSample>& cameras) {
+    std::unordered_map<uint32_t, std::vector<size_t>> by_hash;
+    for (size_t i = 0; i < cameras.size(); ++i) {
+        std::vector<uint32_t> hashes = cameras[i].keyframe_hashes;
+        std::sort(hashes.begin(), hashes.end());
+        hashes.erase(std::unique(hashes.begin(), hashes.end()), hashes.end());
+        for (uint32_t hash : hashes) {
+            if (hash != 0) {
+                by_hash[hash].push_back(i);
+            }
+        }
+    }
+
+    std::map<std::pair<size_t, size_t>, int> shared;
+    for (const auto& entry : by_hash) {
+        const std::vector<size_t>& owners = entry.second;
+        for (size_t a = 0; a < owners.size(); ++a) {
+            for (size_t b = a + 1; b < owners.size(); ++b) {
+                ++shared[{owners[a], owners[b]}];
+            }
+        }
+    }
+
+    // Union-find over the pairs that share enough keyframes
+    std::vector<size_t> parent(cameras.size());
+    std::iota(parent.begin(), parent.end(), 0);
+    auto find = [&parent](size_t i) {
+        while (parent[i] != i) {
+            i = parent[i] = parent[parent[i]];
+        }
+        return i;
+    };
+    for (const auto& entry : shared) {
+        if (entry.second >= kMinSharedKeyframes) {
+            parent[find(entry.first.first)] = find(entry.first.second);
+        }
+    }
+
+    std::map<size_t, std::vector<std::string>> members;
+    for (size_t i = 0; i < cameras.size(); ++i) {
+        members[find(i)].push_back(cameras[i].name);
+    }
+    std::vector<std::vector<std::string>> groups;
+    for (auto& entry : members) {
+        if (entry.second.size() > 1) {
+            std::sort(entry.second.begin(), entry.second.end());
+            groups.push_back(std::move(entry.second));
+        }
+    }
+    std::sort(groups.begin(), groups.end());
+    return groups;
+}
+
+} // namespace duplicates
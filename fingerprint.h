@@ -0,0 +1,119 @@
+#pragma once
+// Scene-change / camera-moved detection on sampled keyframes.
+//
+// Each decoded keyframe is reduced to a 64-bit difference hash (dHash): the
+// luma plane is area-averaged down to 9x8 cells and every bit says whether a
+// cell is brighter than its right neighbour. Lighting changes shift all cells
+// together and leave most bits alone, while a camera that was turned, tilted or
+// blocked flips many of them. The baseline is the bitwise majority of the last
+// few fingerprints, so comparing is one popcount and thousands of cameras cost
+// a few hundred bytes each.
+#include "image_metrics.h"
+#include <bit>
+#include <cstdint>
+#include <deque>
+#include <vector>
+
+namespace fingerprint {
+
+// Area average down to 9x8 cells, then one bit per horizontal neighbour pair
+inline uint64_t dhash(const uint8_t* luma, int width, int height) {
+    constexpr int kCols = 9;
+    constexpr int kRows = 8;
+    if (width < kCols || height < kRows) {
+        return 0;
+    }
+    int col_start[kCols + 1];
+    for (int c = 0; c <= kCols; ++c) {
+        col_start[c] = static_cast<int>(int64_t(c) * width / kCols);
+    }
+    uint64_t cells[kRows][kCols] = {};
+    for (int y = 0; y < height; ++y) {
+        int r = static_cast<int>(int64_t(y) * kRows / height);
+        const uint8_t* row = luma + size_t(y) * width;
+        for (int c = 0; c < kCols; ++c) {
+            cells[r][c] += image_metrics::sum(row + col_start[c], col_start[c + 1] - col_start[c]);
+        }
+    }
+    // Cells of one row have the same height, so comparing means only needs the widths
+    uint64_t hash = 0;
+    for (int r = 0; r < kRows; ++r) {
+        for (int c = 0; c + 1 < kCols; ++c) {
+            uint64_t left = cells[r][c] * uint64_t(col_start[c + 2] - col_start[c + 1]);
+            uint64_t right = cells[r][c + 1] * uint64_t(col_start[c + 1] - col_start[c]);
+            hash = (hash << 1) | (left > right ? 1 : 0);
+        }
+    }
+    return hash;
+}
+
+inline int distance(uint64_t a, uint64_t b) {
+    return std::popcount(a ^ b);
+}
+
+} // namespace fingerprint
+
+struct SceneState {
+    bool valid = false;     // False until the baseline has enough fingerprints
+    uint64_t fingerprint = 0;
+    int distance = 0;       // Bits differing from the baseline, 0..64
+    bool moved = false;     // View differs from the baseline on consecutive samples
+};
+
+class SceneTracker {
+public:
+    static constexpr size_t kBaselineSize = 8;   // Fingerprints voted into the baseline
+    static constexpr size_t kMinBaseline = 3;    // Needed before anything is judged
+    static constexpr int kMovedBits = 18;        // Distance that counts as a different view
+    static constexpr int kConfirmSamples = 2;    // Consecutive far samples before flagging
+
+    // Once the new view has lasted a full baseline it becomes the baseline, so a
+    // camera that was re-aimed on purpose stops alerting on its own.
+    SceneState on_fingerprint(uint64_t hash) {
+        SceneState state;
+        state.fingerprint = hash;
+        if (baseline.size() < kMinBaseline) {
+            baseline.push_back(hash);
+            return state;
+        }
+        state.valid = true;
+        state.distance = fingerprint::distance(hash, majority(baseline));
+        if (state.distance < kMovedBits) {
+            candidates.clear();
+            push(baseline, hash);
+        } else {
+            push(candidates, hash);
+            if (candidates.size() >= kBaselineSize) {
+                baseline.swap(candidates);
+                candidates.clear();
+            }
+        }
+        state.moved = candidates.size() >= static_cast<size_t>(kConfirmSamples);
+        return state;
+    }
+
+private:
+    static void push(std::deque<uint64_t>& ring, uint64_t hash) {
+        ring.push_back(hash);
+        if (ring.size() > kBaselineSize) {
+            ring.pop_front();
+        }
+    }
+
+    static uint64_t majority(const std::deque<uint64_t>& ring) {
+        uint64_t result = 0;
+        for (int bit = 0; bit < 64; ++bit) {
+            size_t votes = 0;
+            for (uint64_t hash : ring) {
+                votes += (hash >> bit) & 1;
+            }
+            if (2 * votes > ring.size()) {
+                result |= uint64_t(1) << bit;
+            }
+        }
+        return result;
+    }
+
+    std::deque<uint64_t> baseline;
+    std::deque<uint64_t> candidates;
+};
@@ -0,0 +1,136 @@
+#pragma once
+// Sliding-window and EWMA frame rate estimators.
+// Both are written by the camera's streaming thread only and read by the
+// reporting thread without locks: every piece of shared state is packed into
+// a single 64-bit atomic, so a reader never sees a torn value. A new window
+// from reset() is applied by the writer on its next frame.
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+
+class FpsEstimators {
+public:
+    static constexpr int kBuckets = 64;
+
+    // window_ns is both the sliding window length and the EWMA time constant.
+    explicit FpsEstimators(int64_t window_ns) {
+        bucket_ns.store(bucket_for(window_ns), std::memory_order_relaxed);
+        alpha = 1.0 - std::exp(-1.0 / kBuckets);
+        for (auto& bucket : buckets) {
+            bucket.store(0, std::memory_order_relaxed);
+        }
+    }
+
+    // Any thread; the EWMA carries over, the sliding window starts empty
+    void reset(int64_t window_ns) {
+        requested_bucket_ns.store(bucket_for(window_ns), std::memory_order_relaxed);
+    }
+
+    // Called for every frame from the streaming thread, steady clock nanoseconds.
+    void on_frame(int64_t now_ns) {
+        if (requested_bucket_ns.load(std::memory_order_relaxed) != 0) {
+            apply_reset(requested_bucket_ns.exchange(0, std::memory_order_relaxed), now_ns);
+        }
+        int64_t bucket_ns = this->bucket_ns.load(std::memory_order_relaxed);
+        uint64_t epoch = now_ns / bucket_ns;
+
+        // Sliding window: epoch in the upper 40 bits, count in the lower 24
+        std::atomic<uint64_t>& bucket = buckets[epoch % kBuckets];
+        uint64_t packed = bucket.load(std::memory_order_relaxed);
+        uint64_t count = (packed >> 24) == (epoch & kEpochMask) ? (packed & kCountMask) + 1 : 1;
+        bucket.store(((epoch & kEpochMask) << 24) | std::min<uint64_t>(count, kCountMask), std::memory_order_relaxed);
+
+        // EWMA: fold the previous bucket (and zeros for any empty ones) once per bucket
+        if (epoch != open_epoch) {
+            if (open_epoch != 0) {
+                double bucket_rate = open_count * 1e9 / bucket_ns;
+                ewma = ewma * (1.0 - alpha) + alpha * bucket_rate;
+                uint64_t skipped = epoch - open_epoch - 1;
+                if (skipped > 0) {
+                    ewma *= std::pow(1.0 - alpha, static_cast<double>(skipped));
+                }
+                store_ewma(ewma, epoch - 1);
+            }
+            open_epoch = epoch;
+            open_count = 0;
+        }
+        ++open_count;
+    }
+
+    double sliding_fps(int64_t now_ns) const {
+        int64_t bucket_ns = this->bucket_ns.load(std::memory_order_relaxed);
+        uint64_t epoch = now_ns / bucket_ns;
+        uint64_t frames = 0;
+        for (const auto& bucket : buckets) {
+            uint64_t packed = bucket.load(std::memory_order_relaxed);
+            uint64_t age = (epoch - (packed >> 24)) & kEpochMask;
+            if (age < kBuckets) {
+                frames += packed & kCountMask;
+            }
+        }
+        // The current bucket is only partly elapsed
+        double span_ns = (kBuckets - 1) * static_cast<double>(bucket_ns) + (now_ns % bucket_ns);
+        return frames * 1e9 / span_ns;
+    }
+
+    double ewma_fps(int64_t now_ns) const {
+        uint64_t packed = packed_ewma.load(std::memory_order_relaxed);
+        if (packed == 0) {
+            return 0.0;
+        }
+        int64_t bucket_ns = this->bucket_ns.load(std::memory_order_relaxed);
+        float value;
+        uint32_t bits = static_cast<uint32_t>(packed >> 32);
+        std::memcpy(&value, &bits, sizeof(value));
+        // Decay over buckets the writer has not folded yet, e.g. during a stall
+        uint32_t last_epoch = static_cast<uint32_t>(packed);
+        uint32_t elapsed = static_cast<uint32_t>(now_ns / bucket_ns) - last_epoch;
+        if (elapsed > 1) {
+            value *= static_cast<float>(std::pow(1.0 - alpha, elapsed - 1));
+        }
+        return value;
+    }
+
+private:
+    static constexpr uint64_t kEpochMask = (1ull << 40) - 1;
+    static constexpr uint64_t kCountMask = (1ull << 24) - 1;
+
+    static int64_t bucket_for(int64_t window_ns) {
+        return window_ns / kBuckets > 1000000 ? window_ns / kBuckets : 1000000;
+    }
+
+    // Buckets stamped with epochs of the old length look ages out of range to
+    // readers, so clearing them after switching the length is safe
+    void apply_reset(int64_t new_bucket_ns, int64_t now_ns) {
+        bucket_ns.store(new_bucket_ns, std::memory_order_relaxed);
+        for (auto& bucket : buckets) {
+            bucket.store(0, std::memory_order_relaxed);
+        }
+        uint64_t epoch = now_ns / new_bucket_ns;
+        if (open_epoch != 0) {
+            store_ewma(ewma, epoch - 1);
+        }
+        open_epoch = epoch;
+        open_count = 0;
+    }
+
+    void store_ewma(double value, uint64_t epoch) {
+        float narrowed = static_cast<float>(value);
+        uint32_t bits;
+        std::memcpy(&bits, &narrowed, sizeof(bits));
+        packed_ewma.store((static_cast<uint64_t>(bits) << 32) | static_cast<uint32_t>(epoch), std::memory_order_relaxed);
+    }
+
+    std::atomic<int64_t> bucket_ns;
+    std::atomic<int64_t> requested_bucket_ns{0}; // From reset(), 0 when none is pending
+    double alpha; // Per-bucket smoothing factor for a time constant of one window
+    std::atomic<uint64_t> buckets[kBuckets];
+    std::atomic<uint64_t> packed_ewma{0}; // float value in the upper 32 bits, epoch in the lower 32
+
+    // Writer-only state
+    uint64_t open_epoch = 0;
+    uint64_t open_count = 0;
+    double ewma = 0.0;
+};
@@ -0,0 +1,398 @@
+#include "tsdb.h"
+#include <algorithm>
+#include <dirent.h>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Offline uptime / SLA report over the history written by `check_fps --tsdb <dir>`.
+
+constexpr double kBinWidth = 0.25; // FPS histogram resolution
+constexpr int kBins = 1024;        // Covers 0..256 FPS, higher values land in the last bin
+constexpr size_t kWorstWindows = 10;
+constexpr size_t kRecentDeltas = 15; // Sample spacings the typical interval is the median of
+
+struct Options {
+    std::string dir;
+    int64_t from_ms = 0;
+    int64_t to_ms = INT64_MAX;
+    double threshold = 5.0;   // Same "red" threshold as the console output
+    int64_t window_ms = 300 * 1000;
+    std::string groups_file;
+    unsigned threads = std::max(1u, std::thread::hardware_concurrency());
+};
+
+struct Window {
+    std::string camera;
+    int64_t start_ms;
+    double avg_fps;
+};
+
+struct CameraStats {
+    std::string name;
+    int64_t covered_ms = 0;
+    int64_t up_ms = 0;       // FPS > 0
+    int64_t below_ms = 0;    // FPS below the threshold
+    int outages = 0;
+    int ongoing = 0;         // Outages still open at the end of the range, included in outages
+    int64_t outage_ms = 0;
+    std::vector<uint64_t> histogram = std::vector<uint64_t>(kBins); // Weighted by milliseconds
+    std::vector<Window> worst;
+
+    // Streaming state while scanning, samples arrive in time order
+    int64_t last_ms = 0;
+    int64_t typical_ms = 0;
+    std::vector<int64_t> recent_deltas;
+    size_t next_delta = 0;
+    bool down = false;
+    int64_t down_ms = 0;     // Covered time of the open outage
+    int64_t window_index = -1;
+    double window_sum = 0.0;
+    int64_t window_covered = 0;
+};
+
+void keep_worst(std::vector<Window>& worst, Window window) {
+    auto better = [](const Window& a, const Window& b) { return a.avg_fps < b.avg_fps; };
+    if (worst.size() < kWorstWindows) {
+        worst.push_back(window);
+        std::push_heap(worst.begin(), worst.end(), better);
+    } else if (window.avg_fps < worst.front().avg_fps) {
+        std::pop_heap(worst.begin(), worst.end(), better);
+        worst.back() = window;
+        std::push_heap(worst.begin(), worst.end(), better);
+    }
+}
+
+void close_window(CameraStats& stats, const Options& options) {
+    // Windows with less than half coverage say more about the monitor than the camera
+    if (stats.window_index >= 0 && stats.window_covered * 2 >= options.window_ms) {
+        keep_worst(stats.worst, {stats.name, stats.window_index * options.window_ms,
+                                 stats.window_sum / stats.window_covered});
+    }
+    stats.window_sum = 0.0;
+    stats.window_covered = 0;
+}
+
+// The median of recent spacings survives the odd close pair around a restart
+// and follows an interval change after a few samples
+void update_typical(CameraStats& stats, int64_t delta) {
+    if (stats.recent_deltas.size() < kRecentDeltas) {
+        stats.recent_deltas.push_back(delta);
+    } else {
+        stats.recent_deltas[stats.next_delta] = delta;
+        stats.next_delta = (stats.next_delta + 1) % kRecentDeltas;
+    }
+    std::vector<int64_t> sorted = stats.recent_deltas;
+    std::nth_element(sorted.begin(), sorted.begin() + sorted.size() / 2, sorted.end());
+    stats.typical_ms = sorted[sorted.size() / 2];
+}
+
+void add_point(CameraStats& stats, const tsdb::Point& point, const Options& options) {
+    if (point.timestamp_ms < options.from_ms || point.timestamp_ms >= options.to_ms) {
+        return;
+    }
+
+    // A sample covers the interval since the previous one. Gaps longer than three
+    // intervals mean the monitor itself was down and are not counted.
+    int64_t weight = stats.typical_ms;
+    if (stats.last_ms > 0) {
+        int64_t delta = point.timestamp_ms - stats.last_ms;
+        if (delta > 0) {
+            update_typical(stats, delta);
+        }
+        if (delta > 0 && delta <= 3 * stats.typical_ms) {
+            weight = delta;
+        }
+    }
+    stats.last_ms = point.timestamp_ms;
+    if (weight <= 0) {
+        return;
+    }
+
+    stats.covered_ms += weight;
+    if (point.fps > 0) {
+        stats.up_ms += weight;
+    }
+    if (point.fps < options.threshold) {
+        stats.below_ms += weight;
+    }
+    int bin = std::min(kBins - 1, static_cast<int>(point.fps / kBinWidth));
+    stats.histogram[std::max(0, bin)] += weight;
+
+    // Outage time only adds up covered time, so monitor gaps inside an outage are skipped
+    if (point.fps <= 0) {
+        stats.down = true;
+        stats.down_ms += weight;
+    } else if (stats.down) {
+        stats.down = false;
+        stats.outages++;
+        stats.outage_ms += stats.down_ms;
+        stats.down_ms = 0;
+    }
+
+    int64_t index = point.timestamp_ms / options.window_ms;
+    if (index != stats.window_index) {
+        close_window(stats, options);
+        stats.window_index = index;
+    }
+    stats.window_sum += point.fps * weight;
+    stats.window_covered += weight;
+}
+
+double percentile(const std::vector<uint64_t>& histogram, double fraction) {
+    uint64_t total = 0;
+    for (uint64_t weight : histogram) {
+        total += weight;
+    }
+    if (total == 0) {
+        return 0.0;
+    }
+    uint64_t target = static_cast<uint64_t>(total * fraction);
+    uint64_t seen = 0;
+    for (int bin = 0; bin < kBins; ++bin) {
+        seen += histogram[bin];
+        if (seen > target) {
+            return bin * kBinWidth;
+        }
+    }
+    return (kBins - 1) * kBinWidth;
+}
+
+std::vector<std::string> day_files(const Options& options) {
+    std::vector<std::string> files;
+    DIR* dir = opendir(options.dir.c_str());
+    if (!dir) {
+        std::cerr << "Could not open directory: " << options.dir << std::endl;
+        return files;
+    }
+    // File names are local dates; widen the range by a day on each side for time zones
+    std::string from = tsdb::day_file("", options.from_ms - 86400 * 1000LL).substr(1);
+    std::string to = options.to_ms == INT64_MAX ? "99999999" : tsdb::day_file("", options.to_ms + 86400 * 1000LL).substr(1);
+    while (dirent* entry = readdir(dir)) {
+        std::string name = entry->d_name;
+        if (name.size() == 12 && name.compare(8, 4, ".fts") == 0 && (options.from_ms == 0 || name >= from)
+            && name <= to) {
+            files.push_back(options.dir + "/" + name);
+        }
+    }
+    closedir(dir);
+    std::sort(files.begin(), files.end());
+    return files;
+}
+
+// A camera still down at the end of the range counts with the time seen so far
+void close_outage(CameraStats& stats) {
+    if (stats.down) {
+        stats.down = false;
+        stats.outages++;
+        stats.ongoing++;
+        stats.outage_ms += stats.down_ms;
+        stats.down_ms = 0;
+    }
+}
+
+// Each worker owns the cameras whose name hashes to it and walks every file in
+// date order, so per-camera samples are seen in time order without any locking.
+void scan_worker(const std::vector<std::string>& files, const Options& options, unsigned worker,
+                 std::map<std::string, CameraStats>& cameras) {
+    std::hash<std::string> hash;
+    std::vector<tsdb::Point> points;
+    for (const auto& path : files) {
+        tsdb::FileReader reader;
+        if (!reader.open(path)) {
+            std::cerr << "Skipping unreadable file: " << path << std::endl;
+            continue;
+        }
+        std::map<uint32_t, CameraStats*> mine;
+        reader.scan(
+            [&](uint32_t id, const std::string& name) {
+                if (hash(name) % options.threads == worker) {
+                    CameraStats& stats = cameras[name];
+                    stats.name = name;
+                    mine[id] = &stats;
+                }
+            },
+            [&](const tsdb::RecordHeader& record, const uint8_t* payload) {
+                auto it = mine.find(record.camera_id);
+                if (it == mine.end() || record.last_ms < options.from_ms || record.first_ms >= options.to_ms) {
+                    return;
+                }
+                points.clear();
+                if (!tsdb::decode_block(record, payload, points)) {
+                    std::cerr << "Corrupt block in " << path << std::endl;
+                }
+                for (const auto& point : points) {
+                    add_point(*it->second, point, options);
+                }
+            });
+    }
+    for (auto& entry : cameras) {
+        close_window(entry.second, options);
+        close_outage(entry.second);
+    }
+}
+
+// Lines of "<group> <camera> [<camera>...]"
+std::map<std::string, std::vector<std::string>> read_groups(const std::string& filename) {
+    std::map<std::string, std::vector<std::string>> groups;
+    std::ifstream file(filename);
+    if (!file.is_open()) {
+        std::cerr << "Could not open the file: " << filename << std::endl;
+        return groups;
+    }
+    std::string line;
+    while (std::getline(file, line)) {
+        std::istringstream fields(line);
+        std::string group, camera;
+        if (!(fields >> group)) {
+            continue;
+        }
+        while (fields >> camera) {
+            groups[group].push_back(camera);
+        }
+    }
+    return groups;
+}
+
+void merge(CameraStats& total, const CameraStats& stats) {
+    total.covered_ms += stats.covered_ms;
+    total.up_ms += stats.up_ms;
+    total.below_ms += stats.below_ms;
+    total.outages += stats.outages;
+    total.ongoing += stats.ongoing;
+    total.outage_ms += stats.outage_ms;
+    for (int bin = 0; bin < kBins; ++bin) {
+        total.histogram[bin] += stats.histogram[bin];
+    }
+}
+
+void print_header(const std::string& title) {
+    std::cout << std::left << std::setw(16) << title << std::right
+              << std::setw(10) << "hours" << std::setw(10) << "uptime%" << std::setw(10) << "below%"
+              << std::setw(9) << "outages" << std::setw(9) << "ongoing" << std::setw(10) << "MTTR(s)"
+              << std::setw(8) << "p1" << std::setw(8) << "p5" << std::setw(8) << "p50" << std::setw(8) << "p95"
+              << std::endl;
+}
+
+void print_row(const CameraStats& stats) {
+    double covered = stats.covered_ms > 0 ? static_cast<double>(stats.covered_ms) : 1.0;
+    std::cout << std::left << std::setw(16) << stats.name << std::right << std::fixed
+              << std::setw(10) << std::setprecision(1) << stats.covered_ms / 3600000.0
+              << std::setw(10) << std::setprecision(3) << 100.0 * stats.up_ms / covered
+              << std::setw(10) << std::setprecision(3) << 100.0 * stats.below_ms / covered
+              << std::setw(9) << stats.outages << std::setw(9) << stats.ongoing
+              << std::setw(10) << std::setprecision(1) << (stats.outages ? stats.outage_ms / 1000.0 / stats.outages : 0.0)
+              << std::setprecision(2)
+              << std::setw(8) << percentile(stats.histogram, 0.01) << std::setw(8) << percentile(stats.histogram, 0.05)
+              << std::setw(8) << percentile(stats.histogram, 0.50) << std::setw(8) << percentile(stats.histogram, 0.95)
+              << std::endl;
+}
+
+int64_t parse_time(const std::string& text) {
+    std::tm local = {};
+    const char* end = strptime(text.c_str(), "%Y-%m-%dT%H:%M:%S", &local);
+    if (!end) {
+        local = {};
+        end = strptime(text.c_str(), "%Y-%m-%d", &local);
+    }
+    if (!end || *end) {
+        std::cerr << "Invalid time, expected YYYY-mm-dd[THH:MM:SS]: " << text << std::endl;
+        return -1;
+    }
+    local.tm_isdst = -1;
+    return std::mktime(&local) * 1000LL;
+}
+
+int main(int argc, char* argv[]) {
+    if (argc < 2) {
+        std::cerr << "Usage: " << argv[0] << " <tsdb_dir> [--from <time>] [--to <time>] [--threshold <fps>]"
+                  << " [--window <seconds>] [--groups <file>] [--threads <n>]" << std::endl;
+        return 1;
+    }
+
+    Options options;
+    options.dir = argv[1];
+    for (int i = 2; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--from" && i + 1 < argc) {
+            options.from_ms = parse_time(argv[++i]);
+        } else if (arg == "--to" && i + 1 < argc) {
+            options.to_ms = parse_time(argv[++i]);
+        } else if (arg == "--threshold" && i + 1 < argc) {
+            options.threshold = std::stod(argv[++i]);
+        } else if (arg == "--window" && i + 1 < argc) {
+            options.window_ms = std::stoll(argv[++i]) * 1000;
+        } else if (arg == "--groups" && i + 1 < argc) {
+            options.groups_file = argv[++i];
+        } else if (arg == "--threads" && i + 1 < argc) {
+            options.threads = std::max(1, std::stoi(argv[++i]));
+        } else {
+            std::cerr << "Unknown option: " << arg << std::endl;
+            return 1;
+        }
+    }
+    if (options.from_ms < 0 || options.to_ms < 0 || options.window_ms <= 0) {
+        return 1;
+    }
+
+    std::vector<std::string> files = day_files(options);
+    if (files.empty()) {
+        std::cerr << "No history files in range under: " << options.dir << std::endl;
+        return 1;
+    }
+
+    std::vector<std::map<std::string, CameraStats>> partitions(options.threads);
+    std::vector<std::thread> workers;
+    for (unsigned worker = 0; worker < options.threads; ++worker) {
+        workers.emplace_back(scan_worker, std::cref(files), std::cref(options), worker, std::ref(partitions[worker]));
+    }
+    for (auto& worker : workers) {
+        worker.join();
+    }
+
+    std::map<std::string, CameraStats> cameras;
+    for (auto& partition : partitions) {
+        cameras.merge(partition);
+    }
+
+    print_header("camera");
+    std::vector<Window> worst;
+    for (const auto& entry : cameras) {
+        print_row(entry.second);
+        for (const auto& window : entry.second.worst) {
+            keep_worst(worst, window);
+        }
+    }
+
+    if (!options.groups_file.empty()) {
+        std::cout << std::endl;
+        print_header("group");
+        for (const auto& group : read_groups(options.groups_file)) {
+            CameraStats total;
+            total.name = group.first;
+            for (const auto& camera : group.second) {
+                auto it = cameras.find(camera);
+                if (it != cameras.end()) {
+                    merge(total, it->second);
+                }
+            }
+            print_row(total);
+        }
+    }
+
+    std::sort(worst.begin(), worst.end(), [](const Window& a, const Window& b) { return a.avg_fps < b.avg_fps; });
+    std::cout << std::endl << "Worst " << options.window_ms / 1000 << "s windows:" << std::endl;
+    for (const auto& window : worst) {
+        std::time_t start = window.start_ms / 1000;
+        std::cout << "  " << std::put_time(std::localtime(&start), "%d:%m:%Y %H:%M:%S") << "  " << std::left
+                  << std::setw(16) << window.camera << std::right << std::fixed << std::setprecision(2)
+                  << window.avg_fps << " FPS" << std::endl;
+    }
+    return 0;
+}
@@ -0,0 +1,143 @@
+#pragma once
+// "Frozen but streaming" detection in the encoded domain, without decoding.
+//
+// A camera whose sensor hung usually keeps encoding the same image: keyframes
+// repeat byte for byte apart from their slice headers, and the frames in
+// between are near-empty skip frames of almost constant size. Both signs are
+// checked per GOP from data the counting path already has mapped:
+//  - a CRC32C of the tail of every keyframe (end-aligned, so slice headers of
+//    varying length do not matter), SSE4.2 / ARMv8 CRC when the CPU has it;
+//  - min / max / mean size of the delta frames against the keyframe size.
+// Written by the streaming thread only; frozen() is safe from any thread.
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#if defined(__x86_64__) || defined(__i386__)
+#include <nmmintrin.h>
+#elif defined(__ARM_FEATURE_CRC32)
+#include <arm_acle.h>
+#endif
+
+namespace crc32c {
+
+inline uint32_t update_scalar(uint32_t crc, const uint8_t* data, size_t size) {
+    static const auto table = [] {
+        struct { uint32_t values[256]; } t;
+        for (uint32_t i = 0; i < 256; ++i) {
+            uint32_t value = i;
+            for (int bit = 0; bit < 8; ++bit) {
+                value = (value >> 1) ^ (0x82F63B78u & (0u - (value & 1)));
+            }
+            t.values[i] = value;
+        }
+        return t;
+    }();
+    for (size_t i = 0; i < size; ++i) {
+        crc = table.values[(crc ^ data[i]) & 0xff] ^ (crc >> 8);
+    }
+    return crc;
+}
+
+#if defined(__x86_64__)
+__attribute__((target("sse4.2"))) inline uint32_t update_sse42(uint32_t crc, const uint8_t* data, size_t size) {
+    uint64_t value = crc;
+    for (; size >= 8; data += 8, size -= 8) {
+        uint64_t word;
+        std::memcpy(&word, data, sizeof(word));
+        value = _mm_crc32_u64(value, word);
+    }
+    crc = static_cast<uint32_t>(value);
+    for (; size > 0; ++data, --size) {
+        crc = _mm_crc32_u8(crc, *data);
+    }
+    return crc;
+}
+#endif
+
+inline uint32_t compute(const uint8_t* data, size_t size) {
+    uint32_t crc = 0xffffffffu;
+#if defined(__x86_64__)
+    static const bool has_sse42 = __builtin_cpu_supports("sse4.2");
+    crc = has_sse42 ? update_sse42(crc, data, size) : update_scalar(crc, data, size);
+#elif defined(__ARM_FEATURE_CRC32)
+    for (; size >= 8; data += 8, size -= 8) {
+        uint64_t word;
+        std::memcpy(&word, data, sizeof(word));
+        crc = __crc32cd(crc, word);
+    }
+    for (; size > 0; ++data, --size) {
+        crc = __crc32cb(crc, *data);
+    }
+#else
+    crc = update_scalar(crc, data, size);
+#endif
+    return ~crc;
+}
+
+} // namespace crc32c
+
+class FrozenDetector {
+public:
+    static constexpr size_t kHashSkip = 64;           // Leading bytes left out: AU delimiter, parameter sets, slice header
+    static constexpr size_t kHashBytes = 64 * 1024;   // At most this much of the keyframe tail is hashed
+    static constexpr uint32_t kMinDeltaFrames = 8;    // Shorter GOPs say nothing about delta frame sizes
+    static constexpr double kTinyDeltaRatio = 0.02;   // Mean delta frame below 2% of the keyframe ...
+    static constexpr uint64_t kFlatDeltaBytes = 16;   // ... and all within 16 bytes of each other
+    static constexpr int kFrozenGops = 2;             // Consecutive suspicious GOPs before flagging
+
+    // Called for every frame with the parser output. Intra-only codecs (MJPEG)
+    // have only keyframes, so only the hash check applies to them.
+    void on_frame(const uint8_t* data, size_t size, bool keyframe) {
+        if (!keyframe) {
+            ++delta_count;
+            delta_sum += size;
+            delta_min = std::min<uint64_t>(delta_min, size);
+            delta_max = std::max<uint64_t>(delta_max, size);
+            return;
+        }
+
+        uint32_t hash = 0;
+        if (size > kHashSkip) {
+            size_t length = std::min(size - kHashSkip, kHashBytes);
+            hash = crc32c::compute(data + size - length, length);
+        }
+        bool repeated = has_keyframe && size > kHashSkip && hash == last_hash;
+
+        // Judge the GOP that this keyframe closes
+        bool flat = false;
+        if (has_keyframe && delta_count >= kMinDeltaFrames) {
+            double mean = static_cast<double>(delta_sum) / delta_count;
+            flat = mean < kTinyDeltaRatio * last_keyframe_size && delta_max - delta_min <= kFlatDeltaBytes;
+        }
+        suspicious_gops = repeated || flat ? suspicious_gops + 1 : 0;
+        frozen_flag.store(suspicious_gops >= kFrozenGops, std::memory_order_relaxed);
+
+        has_keyframe = true;
+        last_hash = hash;
+        last_keyframe_size = size;
+        delta_count = 0;
+        delta_sum = 0;
+        delta_min = UINT64_MAX;
+        delta_max = 0;
+    }
+
+    bool frozen() const { return frozen_flag.load(std::memory_order_relaxed); }
+
+    // Tail hash of the latest keyframe, 0 if it was too short; writer thread only
+    uint32_t keyframe_hash() const { return last_hash; }
+
+private:
+    std::atomic<bool> frozen_flag{false};
+
+    // Writer-only state
+    bool has_keyframe = false;
+    uint32_t last_hash = 0;
+    size_t last_keyframe_size = 0;
+    int suspicious_gops = 0;
+    uint32_t delta_count = 0;
+    uint64_t delta_sum = 0;
+    uint64_t delta_min = UINT64_MAX;
+    uint64_t delta_max = 0;
+};
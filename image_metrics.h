@@ -0,0 +1,227 @@
+#pragma once
+// Image quality checks on sampled, decoded keyframes (luma only): black,
+// washed out, out of focus and covered / tampered. The per-pixel kernels run
+// 16 or 32 pixels at a time (SSE2, or AVX2 when the CPU has it); the 256-bin
+// histogram stays scalar but spreads its increments over four tables so
+// repeated values do not serialize on one counter.
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
+struct ImageQuality {
+    bool valid = false;
+    double mean_luma = 0.0;
+    double luma_stddev = 0.0;
+    double blur_score = 0.0;  // Variance of the Laplacian; low means little edge content
+    double dark_pct = 0.0;    // Pixels below 16
+    double clipped_pct = 0.0; // Pixels at 250 and above
+    std::string state;        // ok, black, washed_out, out_of_focus or covered
+};
+
+namespace image_metrics {
+
+constexpr double kBlackMean = 20.0;
+constexpr double kBlackDarkPct = 95.0;
+constexpr double kWashedMean = 220.0;
+constexpr double kWashedClippedPct = 50.0;
+constexpr double kCoveredStddev = 8.0;   // Nearly one flat luma level, e.g. a lens cap or tape
+constexpr double kOutOfFocusBlur = 15.0;
+
+struct LaplacianSums {
+    int64_t sum = 0;
+    int64_t sum_sq = 0;
+};
+
+// 4-neighbour Laplacian over columns [x, x_end) of one interior row
+inline void laplacian_row_scalar(const uint8_t* row, size_t stride, size_t x, size_t x_end, LaplacianSums& sums) {
+    for (; x < x_end; ++x) {
+        int lap = row[x - 1] + row[x + 1] + row[x - stride] + row[x + stride] - 4 * row[x];
+        sums.sum += lap;
+        sums.sum_sq += lap * lap;
+    }
+}
+
+inline uint64_t sum_scalar(const uint8_t* data, size_t size) {
+    uint64_t sum = 0;
+    for (size_t i = 0; i < size; ++i) {
+        sum += data[i];
+    }
+    return sum;
+}
+
+#if defined(__x86_64__)
+inline uint64_t sum_sse2(const uint8_t* data, size_t size) {
+    __m128i total = _mm_setzero_si128();
+    size_t i = 0;
+    for (; i + 16 <= size; i += 16) {
+        __m128i pixels = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+        total = _mm_add_epi64(total, _mm_sad_epu8(pixels, _mm_setzero_si128()));
+    }
+    return uint64_t(_mm_cvtsi128_si64(total)) + uint64_t(_mm_cvtsi128_si64(_mm_unpackhi_epi64(total, total)))
+           + sum_scalar(data + i, size - i);
+}
+
+__attribute__((target("avx2"))) inline uint64_t sum_avx2(const uint8_t* data, size_t size) {
+    __m256i total = _mm256_setzero_si256();
+    size_t i = 0;
+    for (; i + 32 <= size; i += 32) {
+        __m256i pixels = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i));
+        total = _mm256_add_epi64(total, _mm256_sad_epu8(pixels, _mm256_setzero_si256()));
+    }
+    uint64_t lanes[4];
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(lanes), total);
+    return lanes[0] + lanes[1] + lanes[2] + lanes[3] + sum_scalar(data + i, size - i);
+}
+
+// Widens 8 pixels to 16 bits
+inline __m128i load8_epi16(const uint8_t* p) {
+    return _mm_unpacklo_epi8(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(p)), _mm_setzero_si128());
+}
+
+inline void laplacian_row_sse2(const uint8_t* row, size_t stride, size_t x, size_t x_end, LaplacianSums& sums) {
+    // |lap| <= 1020, so one madd pair is at most ~2.1M and 32-bit lanes hold a
+    // row of well over 8K pixels before being flushed
+    __m128i sum = _mm_setzero_si128();
+    __m128i sum_sq = _mm_setzero_si128();
+    const __m128i ones = _mm_set1_epi16(1);
+    for (; x + 8 <= x_end; x += 8) {
+        __m128i center = load8_epi16(row + x);
+        __m128i lap = _mm_add_epi16(_mm_add_epi16(load8_epi16(row + x - 1), load8_epi16(row + x + 1)),
+                                    _mm_add_epi16(load8_epi16(row + x - stride), load8_epi16(row + x + stride)));
+        lap = _mm_sub_epi16(lap, _mm_slli_epi16(center, 2));
+        sum = _mm_add_epi32(sum, _mm_madd_epi16(lap, ones));
+        sum_sq = _mm_add_epi32(sum_sq, _mm_madd_epi16(lap, lap));
+    }
+    int32_t lanes[4];
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(lanes), sum);
+    sums.sum += int64_t(lanes[0]) + lanes[1] + lanes[2] + lanes[3];
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(lanes), sum_sq);
+    sums.sum_sq += int64_t(uint32_t(lanes[0])) + uint32_t(lanes[1]) + uint32_t(lanes[2]) + uint32_t(lanes[3]);
+    laplacian_row_scalar(row, stride, x, x_end, sums);
+}
+
+__attribute__((target("avx2"))) inline __m256i load16_epi16(const uint8_t* p) {
+    return _mm256_cvtepu8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(p)));
+}
+
+__attribute__((target("avx2"))) inline void laplacian_row_avx2(const uint8_t* row, size_t stride, size_t x, size_t x_end,
+                                                               LaplacianSums& sums) {
+    __m256i sum = _mm256_setzero_si256();
+    __m256i sum_sq = _mm256_setzero_si256();
+    const __m256i ones = _mm256_set1_epi16(1);
+    for (; x + 16 <= x_end; x += 16) {
+        __m256i center = load16_epi16(row + x);
+        __m256i lap = _mm256_add_epi16(_mm256_add_epi16(load16_epi16(row + x - 1), load16_epi16(row + x + 1)),
+                                       _mm256_add_epi16(load16_epi16(row + x - stride), load16_epi16(row + x + stride)));
+        lap = _mm256_sub_epi16(lap, _mm256_slli_epi16(center, 2));
+        sum = _mm256_add_epi32(sum, _mm256_madd_epi16(lap, ones));
+        sum_sq = _mm256_add_epi32(sum_sq, _mm256_madd_epi16(lap, lap));
+    }
+    int32_t lanes[8];
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(lanes), sum);
+    for (int32_t lane : lanes) {
+        sums.sum += lane;
+    }
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(lanes), sum_sq);
+    for (int32_t lane : lanes) {
+        sums.sum_sq += uint32_t(lane);
+    }
+    laplacian_row_sse2(row, stride, x, x_end, sums);
+}
+#endif
+
+inline uint64_t sum(const uint8_t* data, size_t size) {
+#if defined(__x86_64__)
+    static const bool has_avx2 = __builtin_cpu_supports("avx2");
+    return has_avx2 ? sum_avx2(data, size) : sum_sse2(data, size);
+#else
+    return sum_scalar(data, size);
+#endif
+}
+
+inline LaplacianSums laplacian(const uint8_t* luma, int width, int height) {
+    LaplacianSums sums;
+#if defined(__x86_64__)
+    static const bool has_avx2 = __builtin_cpu_supports("avx2");
+#endif
+    for (int y = 1; y + 1 < height; ++y) {
+        const uint8_t* row = luma + size_t(y) * width;
+#if defined(__x86_64__)
+        if (has_avx2) {
+            laplacian_row_avx2(row, width, 1, width - 1, sums);
+        } else {
+            laplacian_row_sse2(row, width, 1, width - 1, sums);
+        }
+#else
+        laplacian_row_scalar(row, width, 1, width - 1, sums);
+#endif
+    }
+    return sums;
+}
+
+inline void histogram(const uint8_t* data, size_t size, uint32_t bins[256]) {
+    uint32_t tables[4][256] = {};
+    size_t i = 0;
+    for (; i + 4 <= size; i += 4) {
+        ++tables[0][data[i]];
+        ++tables[1][data[i + 1]];
+        ++tables[2][data[i + 2]];
+        ++tables[3][data[i + 3]];
+    }
+    for (; i < size; ++i) {
+        ++tables[0][data[i]];
+    }
+    for (int bin = 0; bin < 256; ++bin) {
+        bins[bin] = tables[0][bin] + tables[1][bin] + tables[2][bin] + tables[3][bin];
+    }
+}
+
+// Rows are packed, width bytes each
+inline ImageQuality analyze(const uint8_t* luma, int width, int height) {
+    ImageQuality quality;
+    if (width < 3 || height < 3) {
+        return quality;
+    }
+    size_t pixels = size_t(width) * height;
+    uint32_t bins[256];
+    histogram(luma, pixels, bins);
+    double mean = static_cast<double>(sum(luma, pixels)) / pixels;
+    double variance = 0.0;
+    uint64_t dark = 0;
+    uint64_t clipped = 0;
+    for (int bin = 0; bin < 256; ++bin) {
+        variance += bins[bin] * (bin - mean) * (bin - mean);
+        dark += bin < 16 ? bins[bin] : 0;
+        clipped += bin >= 250 ? bins[bin] : 0;
+    }
+    LaplacianSums lap = laplacian(luma, width, height);
+    double count = double(width - 2) * (height - 2);
+    double lap_mean = lap.sum / count;
+
+    quality.valid = true;
+    quality.mean_luma = mean;
+    quality.luma_stddev = std::sqrt(variance / pixels);
+    quality.blur_score = lap.sum_sq / count - lap_mean * lap_mean;
+    quality.dark_pct = 100.0 * dark / pixels;
+    quality.clipped_pct = 100.0 * clipped / pixels;
+
+    if (mean < kBlackMean && quality.dark_pct >= kBlackDarkPct) {
+        quality.state = "black";
+    } else if (mean > kWashedMean || quality.clipped_pct >= kWashedClippedPct) {
+        quality.state = "washed_out";
+    } else if (quality.luma_stddev < kCoveredStddev) {
+        quality.state = "covered";
+    } else if (quality.blur_score < kOutOfFocusBlur) {
+        quality.state = "out_of_focus";
+    } else {
+        quality.state = "ok";
+    }
+    return quality;
+}
+
+} // namespace image_metrics
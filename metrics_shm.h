@@ -0,0 +1,290 @@
+#pragma once
+// Per-camera metrics published into a POSIX shared-memory segment.
+// The layout is fixed so that local readers (see read_metrics.cpp) can map it
+// read-only and take consistent snapshots without talking to check_fps.
+#include <atomic>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <iostream>
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace metrics_shm {
+
+constexpr uint32_t kMagic = 0x31535046; // "FPS1"
+constexpr uint32_t kVersion = 2;
+constexpr size_t kNameSize = 32;
+
+// Payload copied in and out of a slot under its seqlock.
+struct CameraMetrics {
+    char name[kNameSize];
+    int64_t updated_ns;    // CLOCK_REALTIME of the last update
+    float fps;
+    int32_t downtime;      // Consecutive intervals with 0 FPS
+    uint64_t frames_total; // Frames counted since start
+    uint32_t reconnects;
+    uint32_t bitrate_kbps;
+    float jitter_ms;
+    float loss_pct;        // RTP packet loss over the last interval
+    uint32_t packets_lost;
+    float drift_ppm;       // NaN until enough RTCP sender reports arrived
+    float latency_p50_ms;  // NaN when unknown
+    uint16_t width;        // Negotiated resolution, 0 until caps are known
+    uint16_t height;
+    uint32_t removed;      // 1 once the camera was removed at runtime, the other figures are cleared
+    uint32_t reserved[1];  // Room for new fields without changing the slot size
+};
+
+struct alignas(64) Slot {
+    std::atomic<uint32_t> seq; // Odd while the writer is updating the payload
+    uint32_t pad;
+    CameraMetrics data;
+};
+
+struct Header {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t slot_size;
+    uint32_t capacity;
+    std::atomic<uint32_t> count; // Slots in use, only ever grows
+    int32_t pid;
+    int64_t started_ns;
+    uint8_t pad[32];
+};
+
+static_assert(sizeof(Header) == 64, "shared-memory header layout changed");
+static_assert(std::atomic<uint32_t>::is_always_lock_free, "seqlock needs lock-free atomics");
+
+inline size_t segment_size(uint32_t capacity) {
+    return sizeof(Header) + static_cast<size_t>(capacity) * sizeof(Slot);
+}
+
+inline int64_t realtime_ns() {
+    timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return static_cast<int64_t>(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+}
+
+inline Slot* slots(Header* header) {
+    return reinterpret_cast<Slot*>(header + 1);
+}
+
+// Writer side, owned by check_fps. Each camera only ever writes its own slot,
+// so there is exactly one writer per seqlock.
+class Writer {
+public:
+    ~Writer() { close(); }
+
+    bool open(const std::string& name, uint32_t capacity) {
+        // Never attach to another instance's segment; only a dead writer's is replaced
+        int fd = shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0644);
+        if (fd < 0 && errno == EEXIST) {
+            int32_t owner = live_owner(name);
+            if (owner > 0) {
+                std::cerr << "Shared memory segment " << name << " is in use by pid " << owner << std::endl;
+                return false;
+            } else if (owner < 0) {
+                std::cerr << "Shared memory segment " << name << " exists but has no readable header;"
+                          << " remove /dev/shm" << name << " if nothing uses it" << std::endl;
+                return false;
+            }
+            std::cout << "Replacing stale shared memory segment: " << name << std::endl;
+            shm_unlink(name.c_str());
+            fd = shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0644);
+        }
+        if (fd < 0) {
+            std::cerr << "Failed to create shared memory segment: " << name << std::endl;
+            return false;
+        }
+        size = segment_size(capacity);
+        if (ftruncate(fd, size) != 0) {
+            std::cerr << "Failed to size shared memory segment: " << name << std::endl;
+            ::close(fd);
+            return false;
+        }
+        void* addr = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        ::close(fd);
+        if (addr == MAP_FAILED) {
+            std::cerr << "Failed to map shared memory segment: " << name << std::endl;
+            return false;
+        }
+
+        header = static_cast<Header*>(addr);
+        std::memset(addr, 0, size);
+        header->version = kVersion;
+        header->slot_size = sizeof(Slot);
+        header->capacity = capacity;
+        header->pid = getpid();
+        header->started_ns = realtime_ns();
+        // Publish the magic last so readers never see a half-initialised header
+        std::atomic_thread_fence(std::memory_order_release);
+        header->magic = kMagic;
+        segment_name = name;
+        return true;
+    }
+
+    void close() {
+        if (header) {
+            munmap(header, size);
+            shm_unlink(segment_name.c_str());
+            header = nullptr;
+        }
+    }
+
+    bool is_open() const { return header != nullptr; }
+
+    // Returns the slot index for a camera, or -1 if the segment is disabled or
+    // full. A camera added again under the same name gets its old slot back.
+    int add_camera(const std::string& camera_name) {
+        if (!header) {
+            return -1;
+        }
+        uint32_t index = header->count.load(std::memory_order_relaxed);
+        CameraMetrics metrics{};
+        std::strncpy(metrics.name, camera_name.c_str(), kNameSize - 1);
+        for (uint32_t i = 0; i < index; ++i) {
+            if (std::strncmp(slots(header)[i].data.name, camera_name.c_str(), kNameSize - 1) == 0) {
+                publish(i, metrics);  // Clears a removed camera's mark
+                return static_cast<int>(i);
+            }
+        }
+        if (index >= header->capacity) {
+            std::cerr << "Shared memory segment full, not publishing: " << camera_name << std::endl;
+            return -1;
+        }
+        publish(index, metrics);
+        header->count.store(index + 1, std::memory_order_release);
+        return static_cast<int>(index);
+    }
+
+    // Keeps the name so the slot is found again if the camera comes back
+    void remove_camera(int index) {
+        if (!header || index < 0) {
+            return;
+        }
+        CameraMetrics metrics{};
+        std::memcpy(metrics.name, slots(header)[index].data.name, kNameSize);
+        metrics.updated_ns = realtime_ns();
+        metrics.removed = 1;
+        publish(index, metrics);
+    }
+
+    void publish(int index, const CameraMetrics& metrics) {
+        if (!header || index < 0) {
+            return;
+        }
+        Slot& slot = slots(header)[index];
+        uint32_t seq = slot.seq.load(std::memory_order_relaxed);
+        slot.seq.store(seq + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        std::memcpy(&slot.data, &metrics, sizeof(CameraMetrics));
+        slot.seq.store(seq + 2, std::memory_order_release);
+    }
+
+private:
+    // Pid of the segment's writer if it is still running, -1 if the segment
+    // cannot be read (possibly still being set up), 0 if its writer is gone
+    static int32_t live_owner(const std::string& name) {
+        int fd = shm_open(name.c_str(), O_RDONLY, 0);
+        if (fd < 0) {
+            return errno == ENOENT ? 0 : -1;
+        }
+        struct stat st;
+        void* addr = MAP_FAILED;
+        if (fstat(fd, &st) == 0 && static_cast<size_t>(st.st_size) >= sizeof(Header)) {
+            addr = mmap(nullptr, sizeof(Header), PROT_READ, MAP_SHARED, fd, 0);
+        }
+        ::close(fd);
+        if (addr == MAP_FAILED) {
+            return -1;
+        }
+        const Header* existing = static_cast<const Header*>(addr);
+        int32_t pid = existing->magic == kMagic ? existing->pid : -1;
+        munmap(addr, sizeof(Header));
+        if (pid > 0 && kill(pid, 0) != 0 && errno == ESRCH) {
+            return 0;
+        }
+        return pid;
+    }
+
+    Header* header = nullptr;
+    size_t size = 0;
+    std::string segment_name;
+};
+
+// Reader side, used by read_metrics and any other local agent.
+class Reader {
+public:
+    ~Reader() {
+        if (header) {
+            munmap(header, size);
+        }
+    }
+
+    bool open(const std::string& name) {
+        int fd = shm_open(name.c_str(), O_RDONLY, 0);
+        if (fd < 0) {
+            std::cerr << "Could not open shared memory segment: " << name << std::endl;
+            return false;
+        }
+        struct stat st;
+        if (fstat(fd, &st) != 0 || static_cast<size_t>(st.st_size) < sizeof(Header)) {
+            std::cerr << "Shared memory segment is not initialised: " << name << std::endl;
+            ::close(fd);
+            return false;
+        }
+        size = st.st_size;
+        void* addr = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+        ::close(fd);
+        if (addr == MAP_FAILED) {
+            std::cerr << "Failed to map shared memory segment: " << name << std::endl;
+            return false;
+        }
+        header = static_cast<Header*>(addr);
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (header->magic != kMagic || header->version != kVersion || header->slot_size != sizeof(Slot)
+            || segment_size(header->capacity) > size) {
+            std::cerr << "Unsupported shared memory layout in: " << name << std::endl;
+            munmap(header, size);
+            header = nullptr;
+            return false;
+        }
+        return true;
+    }
+
+    uint32_t count() const {
+        return header ? header->count.load(std::memory_order_acquire) : 0;
+    }
+
+    int32_t writer_pid() const { return header ? header->pid : 0; }
+
+    // Copies a consistent snapshot of one slot, retrying while a write is in progress.
+    bool read(uint32_t index, CameraMetrics& out) const {
+        if (index >= count()) {
+            return false;
+        }
+        const Slot& slot = slots(header)[index];
+        for (;;) {
+            uint32_t before = slot.seq.load(std::memory_order_acquire);
+            if (before & 1) {
+                continue;
+            }
+            std::memcpy(&out, &slot.data, sizeof(CameraMetrics));
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (slot.seq.load(std::memory_order_relaxed) == before) {
+                return true;
+            }
+        }
+    }
+
+private:
+    Header* header = nullptr;
+    size_t size = 0;
+};
+
+} // namespace metrics_shm
@@ -0,0 +1,143 @@
+#pragma once
+// Immutable per-tick view of all cameras, built once under fps_mutex and then
+// shared read-only with every consumer (console, structured output, ...).
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <string>
+#include <vector>
+#include "rollups.h"
+#include "rtp_stats.h"
+#include "nal_parser.h"
+#include "image_metrics.h"
+#include "fingerprint.h"
+
+// Negotiated format of a camera's video stream, from the parsebin output caps
+struct StreamInfo {
+    std::string codec;         // H264, H265, MJPEG, MPEG4, or the caps name if unknown
+    std::string profile;       // Empty when the parser does not report it
+    std::string level;
+    int width = 0;
+    int height = 0;
+    double framerate = 0.0;    // 0 when the stream does not signal it
+    std::string stream_format; // avc, hvc1, byte-stream, ...
+
+    bool operator==(const StreamInfo& other) const = default;
+};
+
+// One-line summary for logs, e.g. "H264 main 4.1 1920x1080 25fps byte-stream"
+inline std::string describe_stream(const StreamInfo& info) {
+    std::string text = info.codec.empty() ? "unknown" : info.codec;
+    for (const std::string* field : {&info.profile, &info.level}) {
+        if (!field->empty()) {
+            text += " " + *field;
+        }
+    }
+    if (info.width > 0 && info.height > 0) {
+        text += " " + std::to_string(info.width) + "x" + std::to_string(info.height);
+    }
+    if (info.framerate > 0) {
+        char rate[16];
+        std::snprintf(rate, sizeof(rate), " %gfps", info.framerate);
+        text += rate;
+    }
+    if (!info.stream_format.empty()) {
+        text += " " + info.stream_format;
+    }
+    return text;
+}
+
+// Luma plane of a sampled keyframe, decoded by the DecodePool
+struct DecodedFrame {
+    std::string camera;
+    int64_t timestamp_ms; // Wall clock time the keyframe was submitted
+    int width;
+    int height;
+    std::vector<uint8_t> luma; // width * height, rows packed without padding
+    double decode_ms;
+};
+
+using DecodedFramePtr = std::shared_ptr<const DecodedFrame>;
+
+// One RTSP media stream of a camera (video, audio or ONVIF metadata), counted
+// from its RTP packets before depayloading
+struct TrackSample {
+    std::string track;    // Media type and stream index, e.g. "audio1"
+    std::string media;    // video, audio or application
+    std::string encoding; // RTP encoding name, e.g. H264, PCMA, VND.ONVIF.METADATA
+    double rate;          // Frames/s for video and metadata (marker bit), packets/s for audio
+    double packet_rate;
+    double bitrate_kbps;
+    double age_ms;        // Time since the last packet, -1 before the first one
+};
+
+// Mid-stream format change: new caps, or an in-band VPS/SPS/PPS with new content
+struct StreamEvent {
+    int64_t timestamp_ms;
+    std::string camera;
+    std::string kind;   // "caps", "vps", "sps", "pps", "scene" or "duplicate"
+    std::string detail; // New format, parameter set id, scene moved / restored, or the duplicate group
+};
+
+// Which FPS estimate an output reports
+enum class Estimator { Tumbling, Sliding, Ewma };
+
+struct CameraSample {
+    std::string name;
+    double fps;         // Tumbling window: frames in the last interval
+    double fps_sliding; // Sliding window over the last interval
+    double fps_ewma;    // Exponentially weighted, time constant of one interval
+    int downtime;
+    double bitrate_kbps;
+    double jitter_ms;   // Standard deviation of frame inter-arrival time
+    int relay_clients;  // RTSP clients pulling this camera from the relay, 0 without --relay
+    double relay_egress_kbps; // Sent to those clients, all of them together
+    bool stalled;       // No frames within the stall timeout (or in the last interval)
+    bool frozen;        // Frames keep coming but the encoded image no longer changes
+    double frame_age_ms; // Time since the last frame, -1 before the first one
+    RtpIntervalStats rtp; // Packet loss / reordering over the last interval, all SSRCs
+    double drift_ppm;     // Camera media clock vs host clock from RTCP SRs, NaN if unknown
+    double latency_p50_ms; // Capture-to-arrival latency, NaN without SRs or NTP sync
+    double latency_p95_ms;
+    double latency_p99_ms;
+    StreamInfo stream;    // Current negotiated format, empty until caps are known
+    uint32_t caps_changes;          // Renegotiations in the last interval
+    uint32_t parameter_set_changes; // In-band VPS/SPS/PPS replacements in the last interval
+    FrameTypeCounts frame_types;    // H.264/H.265 frame and NAL types in the last interval
+    ImageQuality image;             // From the latest sampled keyframe, invalid without --decode-every
+    SceneState scene;               // Fingerprint distance of the latest sampled keyframe to the usual view
+    std::vector<uint32_t> keyframe_hashes; // Payload hashes of the last few keyframes, oldest first
+    std::string duplicate_group;    // First camera of its group of identical streams, empty if unique
+    DecodedFramePtr frame;          // The latest sampled keyframe itself, shared, never copied
+    std::vector<TrackSample> tracks; // Every RTSP media stream, the counted video one included
+};
+
+struct MetricsSnapshot {
+    int64_t timestamp_ms; // Wall clock time of the tick
+    std::vector<CameraSample> cameras;
+    std::vector<RollupRecord> rollups; // Buckets closed since the previous tick, with --rollups
+    std::vector<StreamEvent> events;   // Format changes since the previous tick
+};
+
+inline double estimate(const CameraSample& camera, Estimator estimator) {
+    switch (estimator) {
+        case Estimator::Sliding: return camera.fps_sliding;
+        case Estimator::Ewma: return camera.fps_ewma;
+        default: return camera.fps;
+    }
+}
+
+inline bool parse_estimator(const std::string& name, Estimator& estimator) {
+    if (name == "tumbling") {
+        estimator = Estimator::Tumbling;
+    } else if (name == "sliding") {
+        estimator = Estimator::Sliding;
+    } else if (name == "ewma") {
+        estimator = Estimator::Ewma;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+using SnapshotPtr = std::shared_ptr<const MetricsSnapshot>;
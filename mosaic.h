@@ -0,0 +1,359 @@
+#pragma once
+// Periodic thumbnail mosaic of all cameras for a NOC wall.
+//
+// Tiles come from the keyframes the DecodePool already samples, so the mosaic
+// adds no decoding of its own. Each frame is shrunk by repeated 2x2 box
+// averaging (SSE2, 16 output pixels per step) until it is within 2x of the
+// tile, then bilinearly resampled to the exact tile size. Tiles are cached per
+// camera and only rescaled when a new keyframe arrived, so a refresh of
+// hundreds of cameras is mostly compositing. Each tile gets a name / FPS
+// overlay, and the grayscale canvas is encoded to JPEG or PNG by GStreamer on
+// the mosaic's own thread.
+#include "metrics_snapshot.h"
+#include <gst/gst.h>
+#include <gst/app/gstappsrc.h>
+#include <gst/app/gstappsink.h>
+#include <cmath>
+#include <condition_variable>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#if defined(__x86_64__)
+#include <emmintrin.h>
+#endif
+
+namespace mosaic {
+
+// Averages 2x2 blocks; odd trailing rows / columns are dropped
+inline void halve(const uint8_t* src, int width, int height, std::vector<uint8_t>& dst) {
+    int out_w = width / 2;
+    int out_h = height / 2;
+    dst.resize(size_t(out_w) * out_h);
+    for (int y = 0; y < out_h; ++y) {
+        const uint8_t* top = src + size_t(2 * y) * width;
+        const uint8_t* bottom = top + width;
+        uint8_t* out = &dst[size_t(y) * out_w];
+        int x = 0;
+#if defined(__x86_64__)
+        const __m128i low_bytes = _mm_set1_epi16(0x00ff);
+        for (; x + 16 <= out_w; x += 16) {
+            // Vertical average, then even and odd columns averaged as 16-bit lanes
+            __m128i a = _mm_avg_epu8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(top + 2 * x)),
+                                     _mm_loadu_si128(reinterpret_cast<const __m128i*>(bottom + 2 * x)));
+            __m128i b = _mm_avg_epu8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(top + 2 * x + 16)),
+                                     _mm_loadu_si128(reinterpret_cast<const __m128i*>(bottom + 2 * x + 16)));
+            __m128i a_avg = _mm_avg_epu16(_mm_and_si128(a, low_bytes), _mm_srli_epi16(a, 8));
+            __m128i b_avg = _mm_avg_epu16(_mm_and_si128(b, low_bytes), _mm_srli_epi16(b, 8));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(out + x), _mm_packus_epi16(a_avg, b_avg));
+        }
+#endif
+        for (; x < out_w; ++x) {
+            int v1 = (top[2 * x] + bottom[2 * x] + 1) >> 1;
+            int v2 = (top[2 * x + 1] + bottom[2 * x + 1] + 1) >> 1;
+            out[x] = static_cast<uint8_t>((v1 + v2 + 1) >> 1);
+        }
+    }
+}
+
+inline void resize_bilinear(const uint8_t* src, int width, int height, uint8_t* dst, int dst_stride, int out_w,
+                            int out_h) {
+    for (int y = 0; y < out_h; ++y) {
+        float fy = std::max(0.0f, (y + 0.5f) * height / out_h - 0.5f);
+        int y0 = std::min(static_cast<int>(fy), height - 1);
+        int y1 = std::min(y0 + 1, height - 1);
+        float wy = fy - y0;
+        for (int x = 0; x < out_w; ++x) {
+            float fx = std::max(0.0f, (x + 0.5f) * width / out_w - 0.5f);
+            int x0 = std::min(static_cast<int>(fx), width - 1);
+            int x1 = std::min(x0 + 1, width - 1);
+            float wx = fx - x0;
+            float top = src[size_t(y0) * width + x0] * (1 - wx) + src[size_t(y0) * width + x1] * wx;
+            float bottom = src[size_t(y1) * width + x0] * (1 - wx) + src[size_t(y1) * width + x1] * wx;
+            dst[size_t(y) * dst_stride + x] = static_cast<uint8_t>(top * (1 - wy) + bottom * wy + 0.5f);
+        }
+    }
+}
+
+// Scales a whole frame to exactly tile_w x tile_h, rows packed
+inline std::vector<uint8_t> scale_to_tile(const DecodedFrame& frame, int tile_w, int tile_h) {
+    std::vector<uint8_t> current;
+    std::vector<uint8_t> next;
+    const uint8_t* data = frame.luma.data();
+    int width = frame.width;
+    int height = frame.height;
+    while (width >= 2 * tile_w && height >= 2 * tile_h) {
+        halve(data, width, height, next);
+        current.swap(next);
+        data = current.data();
+        width /= 2;
+        height /= 2;
+    }
+    std::vector<uint8_t> tile(size_t(tile_w) * tile_h);
+    resize_bilinear(data, width, height, tile.data(), tile_w, tile_w, tile_h);
+    return tile;
+}
+
+// Classic 5x7 font, five columns per glyph with bit 0 at the top, for ' ' to 'Z'
+constexpr uint8_t kFont[][5] = {
+    {0x00, 0x00, 0x00, 0x00, 0x00}, {0x00, 0x00, 0x5F, 0x00, 0x00}, {0x00, 0x07, 0x00, 0x07, 0x00},
+    {0x14, 0x7F, 0x14, 0x7F, 0x14}, {0x24, 0x2A, 0x7F, 0x2A, 0x12}, {0x23, 0x13, 0x08, 0x64, 0x62},
+    {0x36, 0x49, 0x55, 0x22, 0x50}, {0x00, 0x05, 0x03, 0x00, 0x00}, {0x00, 0x1C, 0x22, 0x41, 0x00},
+    {0x00, 0x41, 0x22, 0x1C, 0x00}, {0x08, 0x2A, 0x1C, 0x2A, 0x08}, {0x08, 0x08, 0x3E, 0x08, 0x08},
+    {0x00, 0x50, 0x30, 0x00, 0x00}, {0x08, 0x08, 0x08, 0x08, 0x08}, {0x00, 0x60, 0x60, 0x00, 0x00},
+    {0x20, 0x10, 0x08, 0x04, 0x02}, {0x3E, 0x51, 0x49, 0x45, 0x3E}, {0x00, 0x42, 0x7F, 0x40, 0x00},
+    {0x42, 0x61, 0x51, 0x49, 0x46}, {0x21, 0x41, 0x45, 0x4B, 0x31}, {0x18, 0x14, 0x12, 0x7F, 0x10},
+    {0x27, 0x45, 0x45, 0x45, 0x39}, {0x3C, 0x4A, 0x49, 0x49, 0x30}, {0x01, 0x71, 0x09, 0x05, 0x03},
+    {0x36, 0x49, 0x49, 0x49, 0x36}, {0x06, 0x49, 0x49, 0x29, 0x1E}, {0x00, 0x36, 0x36, 0x00, 0x00},
+    {0x00, 0x56, 0x36, 0x00, 0x00}, {0x00, 0x08, 0x14, 0x22, 0x41}, {0x14, 0x14, 0x14, 0x14, 0x14},
+    {0x41, 0x22, 0x14, 0x08, 0x00}, {0x02, 0x01, 0x51, 0x09, 0x06}, {0x32, 0x49, 0x79, 0x41, 0x3E},
+    {0x7E, 0x11, 0x11, 0x11, 0x7E}, {0x7F, 0x49, 0x49, 0x49, 0x36}, {0x3E, 0x41, 0x41, 0x41, 0x22},
+    {0x7F, 0x41, 0x41, 0x22, 0x1C}, {0x7F, 0x49, 0x49, 0x49, 0x41}, {0x7F, 0x09, 0x09, 0x01, 0x01},
+    {0x3E, 0x41, 0x41, 0x51, 0x32}, {0x7F, 0x08, 0x08, 0x08, 0x7F}, {0x00, 0x41, 0x7F, 0x41, 0x00},
+    {0x20, 0x40, 0x41, 0x3F, 0x01}, {0x7F, 0x08, 0x14, 0x22, 0x41}, {0x7F, 0x40, 0x40, 0x40, 0x40},
+    {0x7F, 0x02, 0x04, 0x02, 0x7F}, {0x7F, 0x04, 0x08, 0x10, 0x7F}, {0x3E, 0x41, 0x41, 0x41, 0x3E},
+    {0x7F, 0x09, 0x09, 0x09, 0x06}, {0x3E, 0x41, 0x51, 0x21, 0x5E}, {0x7F, 0x09, 0x19, 0x29, 0x46},
+    {0x46, 0x49, 0x49, 0x49, 0x31}, {0x01, 0x01, 0x7F, 0x01, 0x01}, {0x3F, 0x40, 0x40, 0x40, 0x3F},
+    {0x1F, 0x20, 0x40, 0x20, 0x1F}, {0x7F, 0x20, 0x18, 0x20, 0x7F}, {0x63, 0x14, 0x08, 0x14, 0x63},
+    {0x03, 0x04, 0x78, 0x04, 0x03}, {0x61, 0x51, 0x49, 0x45, 0x43},
+};
+
+constexpr int kGlyphWidth = 6;  // 5 columns plus spacing
+constexpr int kGlyphHeight = 8; // 7 rows plus spacing
+
+// Draws text clipped to max_width; lower case is shown as upper case
+inline void draw_text(uint8_t* canvas, int stride, int x, int y, int max_width, const std::string& text, int scale,
+                      uint8_t color) {
+    for (char c : text) {
+        if (x + 5 * scale > max_width) {
+            return;
+        }
+        if (c >= 'a' && c <= 'z') {
+            c = static_cast<char>(c - 'a' + 'A');
+        }
+        if (c == '_') {
+            c = '-';
+        }
+        const uint8_t* glyph = kFont[(c >= ' ' && c <= 'Z') ? c - ' ' : '?' - ' '];
+        for (int col = 0; col < 5; ++col) {
+            for (int row = 0; row < 7; ++row) {
+                if (glyph[col] & (1 << row)) {
+                    for (int dy = 0; dy < scale; ++dy) {
+                        std::memset(canvas + size_t(y + row * scale + dy) * stride + x + col * scale, color, scale);
+                    }
+                }
+            }
+        }
+        x += kGlyphWidth * scale;
+    }
+}
+
+// Encodes a GRAY8 canvas (width a multiple of 4) with jpegenc or pngenc
+inline bool encode(const std::vector<uint8_t>& canvas, int width, int height, bool png, std::vector<uint8_t>& out) {
+    GstElement* pipeline = gst_pipeline_new(NULL);
+    GstElement* appsrc = gst_element_factory_make("appsrc", NULL);
+    GstElement* convert = gst_element_factory_make("videoconvert", NULL);
+    GstElement* encoder = gst_element_factory_make(png ? "pngenc" : "jpegenc", NULL);
+    GstElement* appsink = gst_element_factory_make("appsink", NULL);
+    if (!pipeline || !appsrc || !convert || !encoder || !appsink) {
+        std::cerr << "Failed to create " << (png ? "pngenc" : "jpegenc") << " pipeline for the mosaic" << std::endl;
+        for (GstElement* element : {pipeline, appsrc, convert, encoder, appsink}) {
+            if (element) {
+                gst_object_unref(element);
+            }
+        }
+        return false;
+    }
+    GstCaps* caps = gst_caps_new_simple("video/x-raw", "format", G_TYPE_STRING, "GRAY8", "width", G_TYPE_INT, width,
+                                        "height", G_TYPE_INT, height, "framerate", GST_TYPE_FRACTION, 0, 1, NULL);
+    g_object_set(appsrc, "caps", caps, "format", GST_FORMAT_TIME, NULL);
+    g_object_set(appsink, "sync", FALSE, NULL);
+    gst_caps_unref(caps);
+    gst_bin_add_many(GST_BIN(pipeline), appsrc, convert, encoder, appsink, NULL);
+
+    bool ok = false;
+    if (gst_element_link_many(appsrc, convert, encoder, appsink, NULL)
+        && gst_element_set_state(pipeline, GST_STATE_PLAYING) != GST_STATE_CHANGE_FAILURE) {
+        GstBuffer* buffer = gst_buffer_new_allocate(NULL, canvas.size(), NULL);
+        gst_buffer_fill(buffer, 0, canvas.data(), canvas.size());
+        gst_app_src_push_buffer(GST_APP_SRC(appsrc), buffer);
+        gst_app_src_end_of_stream(GST_APP_SRC(appsrc));
+        GstSample* sample = gst_app_sink_try_pull_sample(GST_APP_SINK(appsink), 10 * GST_SECOND);
+        if (sample) {
+            GstBuffer* encoded = gst_sample_get_buffer(sample);
+            GstMapInfo map;
+            if (encoded && gst_buffer_map(encoded, &map, GST_MAP_READ)) {
+                out.assign(map.data, map.data + map.size);
+                gst_buffer_unmap(encoded, &map);
+                ok = true;
+            }
+            gst_sample_unref(sample);
+        }
+    }
+    gst_element_set_state(pipeline, GST_STATE_NULL);
+    gst_object_unref(pipeline);
+    return ok;
+}
+
+} // namespace mosaic
+
+// Consumes snapshots like the structured writers, but only composes a mosaic
+// once per period; snapshots in between are ignored.
+class MosaicWriter {
+public:
+    MosaicWriter(const std::string& path, int64_t every_ms, int tile_width, int tile_height)
+        : path(path), every_ms(every_ms), tile_w((tile_width + 3) & ~3), tile_h(tile_height) {
+        png = path.size() >= 4 && path.compare(path.size() - 4, 4, ".png") == 0;
+    }
+
+    ~MosaicWriter() { stop(); }
+
+    void start() {
+        worker = std::thread(&MosaicWriter::run, this);
+    }
+
+    void stop() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        cv.notify_one();
+        if (worker.joinable()) {
+            worker.join();
+        }
+    }
+
+    void submit(SnapshotPtr snapshot) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (snapshot->timestamp_ms - last_ms < every_ms) {
+                return;
+            }
+            last_ms = snapshot->timestamp_ms;
+            pending = std::move(snapshot); // A slow encode just skips a period
+        }
+        cv.notify_one();
+    }
+
+private:
+    void run() {
+        for (;;) {
+            SnapshotPtr snapshot;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                cv.wait(lock, [this] { return stopping || pending; });
+                if (stopping) {
+                    return;
+                }
+                snapshot.swap(pending);
+            }
+            write(*snapshot);
+        }
+    }
+
+    void write(const MetricsSnapshot& snapshot) {
+        size_t count = snapshot.cameras.size();
+        if (count == 0) {
+            return;
+        }
+        int columns = static_cast<int>(std::ceil(std::sqrt(static_cast<double>(count))));
+        int rows = static_cast<int>((count + columns - 1) / columns);
+        int width = columns * tile_w;
+        int height = rows * tile_h;
+        std::vector<uint8_t> canvas(size_t(width) * height, 32);
+        int scale = tile_w >= 480 ? 2 : 1;
+        int bar = (kBarPadding * 2 + mosaic::kGlyphHeight) * scale;
+
+        for (size_t i = 0; i < count; ++i) {
+            const CameraSample& camera = snapshot.cameras[i];
+            int x0 = static_cast<int>(i % columns) * tile_w;
+            int y0 = static_cast<int>(i / columns) * tile_h;
+            uint8_t* origin = canvas.data() + size_t(y0) * width + x0;
+
+            const std::vector<uint8_t>* tile = cached_tile(camera);
+            for (int y = 0; y < tile_h; ++y) {
+                uint8_t* row = origin + size_t(y) * width;
+                if (tile) {
+                    std::memcpy(row, tile->data() + size_t(y) * tile_w, tile_w);
+                }
+                // One-pixel dark border between tiles
+                row[tile_w - 1] = 0;
+                if (y == tile_h - 1) {
+                    std::memset(row, 0, tile_w);
+                }
+            }
+
+            // Overlay bar: light with dark text when the camera is unhealthy
+            double fps = camera.fps;
+            bool alert = camera.stalled || camera.frozen || camera.scene.moved || fps < 5 || (camera.image.valid && camera.image.state != "ok");
+            uint8_t background = alert ? 230 : 0;
+            uint8_t foreground = alert ? 0 : 255;
+            for (int y = 0; y < bar && y < tile_h; ++y) {
+                std::memset(origin + size_t(y) * width, background, tile_w - 1);
+            }
+            char text[96];
+            std::snprintf(text, sizeof(text), "%s %.1f FPS%s", camera.name.c_str(), fps,
+                          camera.frozen ? " FROZEN" : camera.stalled ? " STALLED" : camera.scene.moved ? " MOVED" : "");
+            mosaic::draw_text(origin, width, kBarPadding * scale, kBarPadding * scale, tile_w - 1, text, scale, foreground);
+            if (!tile && bar * 2 < tile_h) {
+                mosaic::draw_text(origin, width, kBarPadding * scale, tile_h / 2, tile_w - 1, "NO IMAGE", scale, 160);
+            }
+        }
+
+        std::vector<uint8_t> encoded;
+        if (!mosaic::encode(canvas, width, height, png, encoded)) {
+            std::cerr << "Failed to encode mosaic: " << path << std::endl;
+            return;
+        }
+        // Write next to the target and rename, so viewers never load half a file
+        std::string temporary = path + ".tmp";
+        FILE* file = std::fopen(temporary.c_str(), "wb");
+        if (!file) {
+            std::cerr << "Could not open mosaic file: " << temporary << std::endl;
+            return;
+        }
+        bool written = std::fwrite(encoded.data(), 1, encoded.size(), file) == encoded.size();
+        written = std::fclose(file) == 0 && written;
+        if (!written || std::rename(temporary.c_str(), path.c_str()) != 0) {
+            std::cerr << "Failed to write mosaic: " << path << std::endl;
+        }
+    }
+
+    // Rescales only when the camera delivered a new keyframe since last time
+    const std::vector<uint8_t>* cached_tile(const CameraSample& camera) {
+        if (!camera.frame) {
+            tiles.erase(camera.name);
+            return nullptr;
+        }
+        Tile& tile = tiles[camera.name];
+        if (tile.frame != camera.frame) {
+            tile.frame = camera.frame;
+            tile.pixels = mosaic::scale_to_tile(*camera.frame, tile_w, tile_h);
+        }
+        return &tile.pixels;
+    }
+
+    static constexpr int kBarPadding = 2;
+
+    struct Tile {
+        DecodedFramePtr frame;
+        std::vector<uint8_t> pixels;
+    };
+
+    std::string path;
+    int64_t every_ms;
+    int tile_w;
+    int tile_h;
+    bool png = false;
+    std::map<std::string, Tile> tiles; // Writer thread only
+    std::mutex mutex;
+    std::condition_variable cv;
+    SnapshotPtr pending;
+    int64_t last_ms = 0;
+    bool stopping = false;
+    std::thread worker;
+};
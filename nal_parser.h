@@ -0,0 +1,356 @@
+#pragma once
+// Minimal H.264 / H.265 NAL unit walker for parser output, used to classify
+// frames (IDR / I / P / B) and notice in-band parameter set (VPS/SPS/PPS)
+// changes without running a decoder. Buffers are either Annex-B byte-stream
+// (start codes) or length-prefixed (avc / hvc1), as announced by the caps.
+//
+// Start codes are searched 16 or 32 bytes at a time (SSE2, or AVX2 when the
+// CPU has it), since at full ingest every byte of every frame passes here.
+#include <cstdint>
+#include <cstring>
+#include <map>
+#include <vector>
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
+enum class NalCodec { None, H264, H265 };
+
+namespace nal_scan {
+
+// First 00 00 01 at or after p, or end
+inline const uint8_t* find_start_code_scalar(const uint8_t* p, const uint8_t* end) {
+    while (p + 2 < end) {
+        // A start code needs p[2] <= 1, so larger bytes skip three positions
+        if (p[2] > 1) {
+            p += 3;
+        } else if (p[2] == 1 && p[1] == 0 && p[0] == 0) {
+            return p;
+        } else {
+            ++p;
+        }
+    }
+    return end;
+}
+
+#if defined(__x86_64__)
+// Compares three shifted loads so every position is tested at once
+inline const uint8_t* find_start_code_sse2(const uint8_t* p, const uint8_t* end) {
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i one = _mm_set1_epi8(1);
+    while (end - p >= 18) {
+        __m128i b0 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+        __m128i b1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + 1));
+        __m128i b2 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + 2));
+        __m128i hit = _mm_and_si128(_mm_and_si128(_mm_cmpeq_epi8(b0, zero), _mm_cmpeq_epi8(b1, zero)),
+                                    _mm_cmpeq_epi8(b2, one));
+        int mask = _mm_movemask_epi8(hit);
+        if (mask) {
+            return p + __builtin_ctz(mask);
+        }
+        p += 16;
+    }
+    return find_start_code_scalar(p, end);
+}
+
+__attribute__((target("avx2"))) inline const uint8_t* find_start_code_avx2(const uint8_t* p, const uint8_t* end) {
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i one = _mm256_set1_epi8(1);
+    while (end - p >= 34) {
+        __m256i b0 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+        __m256i b1 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p + 1));
+        __m256i b2 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p + 2));
+        __m256i hit = _mm256_and_si256(_mm256_and_si256(_mm256_cmpeq_epi8(b0, zero), _mm256_cmpeq_epi8(b1, zero)),
+                                       _mm256_cmpeq_epi8(b2, one));
+        uint32_t mask = static_cast<uint32_t>(_mm256_movemask_epi8(hit));
+        if (mask) {
+            return p + __builtin_ctz(mask);
+        }
+        p += 32;
+    }
+    return find_start_code_sse2(p, end);
+}
+#endif
+
+inline const uint8_t* find_start_code(const uint8_t* p, const uint8_t* end) {
+#if defined(__x86_64__)
+    static const bool has_avx2 = __builtin_cpu_supports("avx2");
+    return has_avx2 ? find_start_code_avx2(p, end) : find_start_code_sse2(p, end);
+#else
+    return find_start_code_scalar(p, end);
+#endif
+}
+
+} // namespace nal_scan
+
+// Calls visit(nal, size) for every NAL unit in the buffer. length_size is the
+// size of the length prefix (1-4), or 0 for Annex-B.
+template <typename Visit>
+void for_each_nal(const uint8_t* data, size_t size, int length_size, Visit visit) {
+    if (length_size > 0) {
+        size_t offset = 0;
+        while (offset + length_size <= size) {
+            size_t length = 0;
+            for (int i = 0; i < length_size; ++i) {
+                length = (length << 8) | data[offset + i];
+            }
+            offset += length_size;
+            if (length == 0 || length > size - offset) {
+                return;
+            }
+            visit(data + offset, length);
+            offset += length;
+        }
+        return;
+    }
+
+    // Annex-B: a NAL unit runs from one 00 00 01 start code to the next. NAL
+    // units never end in a zero byte, so trailing zeros belong to the next
+    // 4-byte start code or are trailing_zero_8bits.
+    const uint8_t* end = data + size;
+    const uint8_t* start = nal_scan::find_start_code(data, end);
+    while (start < end) {
+        const uint8_t* nal = start + 3;
+        const uint8_t* next = nal_scan::find_start_code(nal, end);
+        const uint8_t* nal_end = next;
+        while (nal_end > nal && nal_end[-1] == 0) {
+            --nal_end;
+        }
+        if (nal_end > nal) {
+            visit(nal, nal_end - nal);
+        }
+        start = next;
+    }
+}
+
+inline bool is_parameter_set(NalCodec codec, const uint8_t* nal, size_t size) {
+    if (codec == NalCodec::H264 && size > 1) {
+        int type = nal[0] & 0x1f;
+        return type == 7 || type == 8;
+    }
+    if (codec == NalCodec::H265 && size > 2) {
+        int type = (nal[0] >> 1) & 0x3f;
+        return type >= 32 && type <= 34;
+    }
+    return false;
+}
+
+// Copies the VPS/SPS/PPS NAL units of an access unit as Annex-B, each behind
+// a 4-byte start code
+inline std::vector<uint8_t> extract_parameter_sets(NalCodec codec, const uint8_t* data, size_t size, int length_size) {
+    std::vector<uint8_t> out;
+    for_each_nal(data, size, length_size, [&](const uint8_t* nal, size_t nal_size) {
+        if (is_parameter_set(codec, nal, nal_size)) {
+            static const uint8_t start_code[4] = {0, 0, 0, 1};
+            out.insert(out.end(), start_code, start_code + 4);
+            out.insert(out.end(), nal, nal + nal_size);
+        }
+    });
+    return out;
+}
+
+// Bit reader over the start of a NAL payload with emulation prevention bytes removed
+class RbspReader {
+public:
+    RbspReader(const uint8_t* nal, size_t size, size_t header) {
+        int zeros = 0;
+        for (size_t i = header; i < size && length < sizeof(rbsp); ++i) {
+            if (zeros >= 2 && nal[i] == 0x03) {
+                zeros = 0;
+                continue;
+            }
+            zeros = nal[i] == 0 ? zeros + 1 : 0;
+            rbsp[length++] = nal[i];
+        }
+    }
+
+    uint32_t read(int count) {
+        uint32_t value = 0;
+        for (int i = 0; i < count; ++i) {
+            size_t byte = position / 8;
+            uint32_t bit = byte < length ? (rbsp[byte] >> (7 - position % 8)) & 1 : 0;
+            value = (value << 1) | bit;
+            ++position;
+        }
+        return value;
+    }
+
+    void skip(size_t count) { position += count; }
+
+    // Exp-Golomb; the values read here are small, so anything malformed just yields a large value
+    uint32_t ue() {
+        int leading = 0;
+        while (leading < 31 && position < length * 8 && read(1) == 0) {
+            ++leading;
+        }
+        return (1u << leading) - 1 + read(leading);
+    }
+
+private:
+    uint8_t rbsp[64]; // Headers only, never the slice data
+    size_t length = 0;
+    size_t position = 0;
+};
+
+// Remembers a hash of every parameter set by type and id and reports when a
+// set is replaced by different content.
+class ParameterSetTracker {
+public:
+    // Returns "VPS", "SPS" or "PPS" when the NAL replaced a known parameter set
+    // with different content, otherwise nullptr. id receives the set's id.
+    const char* on_nal(NalCodec codec, const uint8_t* nal, size_t size, uint32_t& id) {
+        const char* kind = nullptr;
+        int type = 0;
+        if (codec == NalCodec::H264 && size > 1) {
+            type = nal[0] & 0x1f;
+            kind = type == 7 ? "SPS" : type == 8 ? "PPS" : nullptr;
+        } else if (codec == NalCodec::H265 && size > 2) {
+            type = (nal[0] >> 1) & 0x3f;
+            kind = type == 32 ? "VPS" : type == 33 ? "SPS" : type == 34 ? "PPS" : nullptr;
+        }
+        if (!kind) {
+            return nullptr;
+        }
+
+        id = parse_id(codec, type, nal, size);
+        uint64_t hash = 14695981039346656037ull; // FNV-1a
+        for (size_t i = 0; i < size; ++i) {
+            hash = (hash ^ nal[i]) * 1099511628211ull;
+        }
+        uint64_t& known = hashes[(uint32_t(type) << 16) | id];
+        bool changed = known != 0 && known != hash;
+        known = hash;
+        return changed ? kind : nullptr;
+    }
+
+private:
+    // Reads the parameter set id from the start of the RBSP
+    static uint32_t parse_id(NalCodec codec, int type, const uint8_t* nal, size_t size) {
+        RbspReader bits(nal, size, codec == NalCodec::H264 ? 1 : 2);
+        if (codec == NalCodec::H264) {
+            if (type == 7) {
+                bits.skip(24); // profile_idc, constraint flags, level_idc
+            }
+            return bits.ue();
+        }
+        if (type == 32) {
+            return bits.read(4);
+        }
+        if (type == 33) {
+            bits.skip(4); // sps_video_parameter_set_id
+            uint32_t sub_layers = bits.read(3);
+            bits.skip(1);
+            bits.skip(96); // General profile, tier and level
+            bool profile_present[8] = {};
+            bool level_present[8] = {};
+            for (uint32_t i = 0; i < sub_layers; ++i) {
+                profile_present[i] = bits.read(1);
+                level_present[i] = bits.read(1);
+            }
+            if (sub_layers > 0) {
+                bits.skip(2 * (8 - sub_layers));
+            }
+            for (uint32_t i = 0; i < sub_layers; ++i) {
+                bits.skip((profile_present[i] ? 88 : 0) + (level_present[i] ? 8 : 0));
+            }
+        }
+        return bits.ue();
+    }
+
+    std::map<uint32_t, uint64_t> hashes; // (type << 16 | id) -> FNV-1a of the NAL
+};
+
+enum class FrameType { Unknown, Idr, Intra, P, B };
+
+struct FrameTypeCounts {
+    uint32_t idr = 0;            // IDR (H.264) or IRAP (H.265) frames
+    uint32_t intra = 0;          // Other I frames
+    uint32_t p = 0;
+    uint32_t b = 0;
+    uint32_t sei = 0;            // SEI NAL units
+    uint32_t parameter_sets = 0; // VPS/SPS/PPS NAL units
+
+    void add(FrameType type) {
+        switch (type) {
+            case FrameType::Idr: ++idr; break;
+            case FrameType::Intra: ++intra; break;
+            case FrameType::P: ++p; break;
+            case FrameType::B: ++b; break;
+            default: break;
+        }
+    }
+
+    void merge(const FrameTypeCounts& other) {
+        idr += other.idr;
+        intra += other.intra;
+        p += other.p;
+        b += other.b;
+        sei += other.sei;
+        parameter_sets += other.parameter_sets;
+    }
+};
+
+// Frame type from the NAL header and slice_type of the first slice of each
+// access unit. Feed every NAL of a frame to on_nal, then call take_frame.
+class FrameClassifier {
+public:
+    void on_nal(NalCodec codec, const uint8_t* nal, size_t size, FrameTypeCounts& counts) {
+        if (codec == NalCodec::H264 && size > 1) {
+            int type = nal[0] & 0x1f;
+            if (type == 6) {
+                ++counts.sei;
+            } else if (type == 7 || type == 8) {
+                ++counts.parameter_sets;
+            } else if ((type == 1 || type == 5) && frame == FrameType::Unknown) {
+                RbspReader bits(nal, size, 1);
+                bits.ue(); // first_mb_in_slice
+                uint32_t slice_type = bits.ue() % 5;
+                frame = type == 5 ? FrameType::Idr : from_slice_type(slice_type == 1 ? 0 : slice_type == 0 || slice_type == 3 ? 1 : 2);
+            }
+        } else if (codec == NalCodec::H265 && size > 2) {
+            int type = (nal[0] >> 1) & 0x3f;
+            if (type == 39 || type == 40) {
+                ++counts.sei;
+            } else if (type >= 32 && type <= 34) {
+                ++counts.parameter_sets;
+                if (type == 34) {
+                    // num_extra_slice_header_bits is needed to reach slice_type
+                    RbspReader bits(nal, size, 2);
+                    bits.ue(); // pps_pic_parameter_set_id
+                    bits.ue(); // pps_seq_parameter_set_id
+                    bits.skip(2); // dependent_slice_segments_enabled_flag, output_flag_present_flag
+                    extra_slice_header_bits = bits.read(3);
+                }
+            } else if (type <= 21 && (type <= 9 || type >= 16) && frame == FrameType::Unknown) {
+                if (type >= 16) {
+                    frame = FrameType::Idr;
+                    return;
+                }
+                RbspReader bits(nal, size, 2);
+                if (!bits.read(1)) {
+                    return; // Not the first slice segment of the picture
+                }
+                bits.ue(); // slice_pic_parameter_set_id
+                bits.skip(extra_slice_header_bits);
+                frame = from_slice_type(bits.ue());
+            }
+        }
+    }
+
+    // Type of the frame just scanned; resets for the next one
+    FrameType take_frame() {
+        FrameType result = frame;
+        frame = FrameType::Unknown;
+        return result;
+    }
+
+private:
+    // H.265 numbering: 0 = B, 1 = P, 2 = I
+    static FrameType from_slice_type(uint32_t slice_type) {
+        return slice_type == 0 ? FrameType::B : slice_type == 1 ? FrameType::P : slice_type == 2 ? FrameType::Intra
+                                                                                                : FrameType::Unknown;
+    }
+
+    FrameType frame = FrameType::Unknown;
+    uint32_t extra_slice_header_bits = 0;
+};
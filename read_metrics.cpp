@@ -0,0 +1,59 @@
+#include "metrics_shm.h"
+#include <iostream>
+#include <thread>
+#include <chrono>
+#include <string>
+#include <iomanip>
+
+// Prints the per-camera metrics published by `check_fps --shm <name>`.
+void print_snapshot(const metrics_shm::Reader& reader) {
+    int64_t now = metrics_shm::realtime_ns();
+    uint32_t count = reader.count();
+    for (uint32_t i = 0; i < count; ++i) {
+        metrics_shm::CameraMetrics metrics;
+        if (!reader.read(i, metrics)) {
+            continue;
+        }
+        double age = metrics.updated_ns ? (now - metrics.updated_ns) / 1e9 : -1.0;
+        if (metrics.removed) {
+            std::cout << std::left << std::setw(12) << metrics.name << std::fixed << std::setprecision(1)
+                      << " removed age=" << age << "s" << std::endl;
+            continue;
+        }
+        std::cout << std::left << std::setw(12) << metrics.name << std::fixed << std::setprecision(1)
+                  << " fps=" << metrics.fps
+                  << " downtime=" << metrics.downtime
+                  << " bitrate=" << metrics.bitrate_kbps << "kbps"
+                  << " jitter=" << metrics.jitter_ms << "ms"
+                  << " loss=" << metrics.loss_pct << "%"
+                  << " drift=" << metrics.drift_ppm << "ppm"
+                  << " resolution=" << metrics.width << "x" << metrics.height
+                  << " latency=" << metrics.latency_p50_ms << "ms"
+                  << " frames=" << metrics.frames_total
+                  << " reconnects=" << metrics.reconnects
+                  << " age=" << age << "s" << std::endl;
+    }
+}
+
+int main(int argc, char* argv[]) {
+    if (argc < 2) {
+        std::cerr << "Usage: " << argv[0] << " <shm_name> [watch_interval_in_seconds]" << std::endl;
+        return 1;
+    }
+
+    metrics_shm::Reader reader;
+    if (!reader.open(argv[1])) {
+        return 1;
+    }
+
+    int interval = argc > 2 ? std::stoi(argv[2]) : 0;
+    do {
+        std::cout << "--- pid " << reader.writer_pid() << ", " << reader.count() << " cameras ---" << std::endl;
+        print_snapshot(reader);
+        if (interval > 0) {
+            std::this_thread::sleep_for(std::chrono::seconds(interval));
+        }
+    } while (interval > 0);
+
+    return 0;
+}
@@ -0,0 +1,317 @@
+#pragma once
+// Monitor-and-relay mode: every camera's parsed stream is re-served at
+// rtsp://<host>:<port>/<camera> by gst-rtsp-server, so an NVR or viewer can
+// pull from the monitor instead of opening a second session to the camera.
+//
+// Frames are handed over in on_new_sample, right where FPS is counted, as
+// shallow buffer copies (the memory is shared, only the timestamps are new),
+// into a shared appsrc ! <parse> ! <pay> media per mount. Frames flow while
+// the server has the media prepared, from the first DESCRIBE (which needs a
+// buffer to build the SDP) until it is unprepared; a slow media drops its
+// oldest frames once kRelayQueueBytes are queued. Client counts are only
+// reported. The RTSP server runs its own main loop thread.
+//
+// Only built when gstreamer-rtsp-server-1.0 is found (HAVE_RTSP_SERVER).
+#ifdef HAVE_RTSP_SERVER
+#include <gst/gst.h>
+#include <gst/app/gstappsrc.h>
+#include <gst/rtsp-server/rtsp-server.h>
+#include <atomic>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+constexpr size_t kRelayQueueBytes = 4 * 1024 * 1024;  // Per mount, before old frames are dropped
+
+class RelayMount {
+public:
+    explicit RelayMount(const std::string& path) : path(path) {}
+
+    ~RelayMount() {
+        detach();
+        if (caps) {
+            gst_caps_unref(caps);
+        }
+    }
+
+    // Streaming thread, every parsed frame
+    void push(GstBuffer* buffer) {
+        std::lock_guard<std::mutex> lock(mutex);
+        // appsrc only exists while the media is prepared, see on_media_configure
+        if (!appsrc) {
+            return;
+        }
+        // The camera's timestamps belong to another pipeline; appsrc stamps arrival
+        // time instead (do-timestamp), which is right for cameras without B-frames
+        GstBuffer* copy = gst_buffer_copy(buffer);
+        GST_BUFFER_PTS(copy) = GST_CLOCK_TIME_NONE;
+        GST_BUFFER_DTS(copy) = GST_CLOCK_TIME_NONE;
+        gst_app_src_push_buffer(GST_APP_SRC(appsrc), copy);
+    }
+
+    int clients() const { return client_count.load(std::memory_order_relaxed); }
+
+    uint64_t take_egress_bytes() { return egress_bytes.exchange(0, std::memory_order_relaxed); }
+
+private:
+    friend class RelayServer;
+
+    void attach(GstElement* source) {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (appsrc) {
+            gst_object_unref(appsrc);
+        }
+        appsrc = source;
+        g_object_set(appsrc, "caps", caps, NULL);
+    }
+
+    void detach() {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (appsrc) {
+            gst_object_unref(appsrc);
+            appsrc = nullptr;
+        }
+    }
+
+    // Every RTP packet leaves once per client
+    static GstPadProbeReturn on_payload(GstPad* pad, GstPadProbeInfo* info, gpointer user_data) {
+        RelayMount* mount = static_cast<RelayMount*>(user_data);
+        uint64_t bytes = 0;
+        if (GST_PAD_PROBE_INFO_TYPE(info) & GST_PAD_PROBE_TYPE_BUFFER_LIST) {
+            GstBufferList* list = GST_PAD_PROBE_INFO_BUFFER_LIST(info);
+            guint length = gst_buffer_list_length(list);
+            for (guint i = 0; i < length; ++i) {
+                bytes += gst_buffer_get_size(gst_buffer_list_get(list, i));
+            }
+        } else {
+            bytes = gst_buffer_get_size(GST_PAD_PROBE_INFO_BUFFER(info));
+        }
+        mount->egress_bytes.fetch_add(bytes * mount->clients(), std::memory_order_relaxed);
+        return GST_PAD_PROBE_OK;
+    }
+
+    std::string path;
+    std::mutex mutex;  // Protects appsrc and caps
+    GstElement* appsrc = nullptr;  // While the shared media is prepared
+    GstCaps* caps = nullptr;
+    std::string codec;  // Media type the mount was created for
+    std::atomic<int> client_count{0};  // For reporting only
+    std::atomic<uint64_t> egress_bytes{0};
+};
+
+class RelayServer {
+public:
+    explicit RelayServer(int port) : port(port) {}
+
+    ~RelayServer() { stop(); }
+
+    bool start() {
+        server = gst_rtsp_server_new();
+        gst_rtsp_server_set_service(server, std::to_string(port).c_str());
+        context = g_main_context_new();
+        loop = g_main_loop_new(context, FALSE);
+        source_id = gst_rtsp_server_attach(server, context);
+        if (source_id == 0) {
+            std::cerr << "Could not start the relay RTSP server on port " << port << std::endl;
+            g_main_loop_unref(loop);
+            g_main_context_unref(context);
+            gst_object_unref(server);
+            loop = nullptr;
+            context = nullptr;
+            server = nullptr;
+            return false;
+        }
+        g_signal_connect(server, "client-connected", G_CALLBACK(&RelayServer::on_client_connected), this);
+        thread = std::thread([this] {
+            g_main_context_push_thread_default(context);
+            g_main_loop_run(loop);
+            g_main_context_pop_thread_default(context);
+        });
+        std::cout << "Relaying cameras at rtsp://<host>:" << port << "/<camera>" << std::endl;
+        return true;
+    }
+
+    void stop() {
+        if (!loop) {
+            return;
+        }
+        g_main_loop_quit(loop);
+        if (thread.joinable()) {
+            thread.join();
+        }
+        g_main_loop_unref(loop);
+        g_main_context_unref(context);
+        loop = nullptr;
+        context = nullptr;
+        // Cameras outlive the server and may still mount or unmount
+        std::lock_guard<std::mutex> lock(mutex);
+        gst_object_unref(server);
+        server = nullptr;
+    }
+
+    // Creates the mount once the parsed format is known; later calls update the
+    // caps for the next media. False when the format has no RTP payloader here.
+    bool mount(const std::shared_ptr<RelayMount>& shared, GstCaps* caps) {
+        RelayMount& mount = *shared;
+        std::string media = gst_structure_get_name(gst_caps_get_structure(caps, 0));
+        {
+            std::lock_guard<std::mutex> lock(mount.mutex);
+            if (mount.caps) {
+                gst_caps_unref(mount.caps);
+            }
+            mount.caps = gst_caps_ref(caps);
+            if (!mount.codec.empty()) {
+                if (media != mount.codec) {
+                    std::cerr << "Relay of " << mount.path << " keeps serving " << mount.codec << ", stream is now " << media
+                              << std::endl;
+                }
+                return true;
+            }
+        }
+        const char* chain = payload_chain(media);
+        if (!chain) {
+            std::cerr << "Cannot relay " << media << " for " << mount.path << std::endl;
+            return false;
+        }
+        mount.codec = media;
+
+        GstRTSPMediaFactory* factory = gst_rtsp_media_factory_new();
+        std::string launch = "( appsrc name=relaysrc is-live=true do-timestamp=true format=time max-bytes=" +
+                             std::to_string(kRelayQueueBytes) + " leaky-type=downstream ! " + std::string(chain) + " )";
+        gst_rtsp_media_factory_set_launch(factory, launch.c_str());
+        gst_rtsp_media_factory_set_shared(factory, TRUE);
+        g_signal_connect(factory, "media-configure", G_CALLBACK(&RelayServer::on_media_configure), &mount);
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (!server) {
+                g_object_unref(factory);
+                return false;
+            }
+            mounts[mount.path] = shared;
+            GstRTSPMountPoints* points = gst_rtsp_server_get_mount_points(server);
+            gst_rtsp_mount_points_add_factory(points, mount.path.c_str(), factory);
+            g_object_unref(points);
+        }
+        std::cout << "Relay mount ready: rtsp://<host>:" << port << mount.path << std::endl;
+        return true;
+    }
+
+    // Stops offering a removed camera. Media already running may still call
+    // into the mount, so it is kept alive until the server stops.
+    void unmount(const RelayMount& mount) {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (!server) {
+            return;
+        }
+        auto found = mounts.find(mount.path);
+        if (found == mounts.end() || found->second.get() != &mount) {
+            return;
+        }
+        GstRTSPMountPoints* points = gst_rtsp_server_get_mount_points(server);
+        gst_rtsp_mount_points_remove_factory(points, mount.path.c_str());
+        g_object_unref(points);
+        retired.push_back(found->second);
+        mounts.erase(found);
+    }
+
+private:
+    static const char* payload_chain(const std::string& media) {
+        if (media == "video/x-h264") {
+            return "h264parse config-interval=-1 ! rtph264pay name=pay0 pt=96 config-interval=-1";
+        } else if (media == "video/x-h265") {
+            return "h265parse config-interval=-1 ! rtph265pay name=pay0 pt=96 config-interval=-1";
+        } else if (media == "image/jpeg") {
+            return "rtpjpegpay name=pay0 pt=26";
+        } else if (media == "video/mpeg") {
+            return "rtpmp4vpay name=pay0 pt=96 config-interval=-1";
+        }
+        return nullptr;
+    }
+
+    static void on_media_configure(GstRTSPMediaFactory* factory, GstRTSPMedia* media, RelayMount* mount) {
+        GstElement* element = gst_rtsp_media_get_element(media);
+        GstElement* appsrc = gst_bin_get_by_name(GST_BIN(element), "relaysrc");
+        GstElement* pay = gst_bin_get_by_name(GST_BIN(element), "pay0");
+        if (pay) {
+            GstPad* pad = gst_element_get_static_pad(pay, "src");
+            gst_pad_add_probe(pad, GstPadProbeType(GST_PAD_PROBE_TYPE_BUFFER | GST_PAD_PROBE_TYPE_BUFFER_LIST),
+                              &RelayMount::on_payload, mount, NULL);
+            gst_object_unref(pad);
+            gst_object_unref(pay);
+        }
+        if (appsrc) {
+            mount->attach(appsrc);  // Takes the reference
+        }
+        g_signal_connect(media, "unprepared", G_CALLBACK(&RelayServer::on_media_unprepared), mount);
+        gst_object_unref(element);
+    }
+
+    static void on_media_unprepared(GstRTSPMedia* media, RelayMount* mount) {
+        mount->detach();
+    }
+
+    static void on_client_connected(GstRTSPServer* server, GstRTSPClient* client, RelayServer* relay) {
+        g_signal_connect(client, "setup-request", G_CALLBACK(&RelayServer::on_setup), relay);
+        g_signal_connect(client, "teardown-request", G_CALLBACK(&RelayServer::on_teardown), relay);
+        g_signal_connect(client, "closed", G_CALLBACK(&RelayServer::on_closed), relay);
+    }
+
+    // SETUP URLs name a stream of the mount, e.g. /cam0/stream=0
+    RelayMount* find_mount(GstRTSPContext* ctx) {
+        if (!ctx || !ctx->uri || !ctx->uri->abspath) {
+            return nullptr;
+        }
+        std::string path = ctx->uri->abspath;
+        size_t stream = path.rfind("/stream=");
+        if (stream != std::string::npos) {
+            path.erase(stream);
+        }
+        std::lock_guard<std::mutex> lock(mutex);
+        auto found = mounts.find(path);
+        return found != mounts.end() ? found->second.get() : nullptr;
+    }
+
+    // Client bookkeeping runs on the server thread only
+    static void on_setup(GstRTSPClient* client, GstRTSPContext* ctx, RelayServer* relay) {
+        RelayMount* mount = relay->find_mount(ctx);
+        if (mount && relay->sessions[client].insert(mount).second) {
+            mount->client_count.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+
+    static void on_teardown(GstRTSPClient* client, GstRTSPContext* ctx, RelayServer* relay) {
+        RelayMount* mount = relay->find_mount(ctx);
+        auto session = relay->sessions.find(client);
+        if (mount && session != relay->sessions.end() && session->second.erase(mount)) {
+            mount->client_count.fetch_sub(1, std::memory_order_relaxed);
+        }
+    }
+
+    static void on_closed(GstRTSPClient* client, RelayServer* relay) {
+        auto session = relay->sessions.find(client);
+        if (session == relay->sessions.end()) {
+            return;
+        }
+        for (RelayMount* mount : session->second) {
+            mount->client_count.fetch_sub(1, std::memory_order_relaxed);
+        }
+        relay->sessions.erase(session);
+    }
+
+    int port;
+    GstRTSPServer* server = nullptr;
+    GMainContext* context = nullptr;
+    GMainLoop* loop = nullptr;
+    guint source_id = 0;
+    std::thread thread;
+    std::mutex mutex;  // Protects mounts, which streaming threads add to, and server
+    std::map<std::string, std::shared_ptr<RelayMount>> mounts;  // By path, e.g. /cam0
+    std::vector<std::shared_ptr<RelayMount>> retired;  // Unmounted, see unmount()
+    std::map<GstRTSPClient*, std::set<RelayMount*>> sessions;  // Mounts each client set up
+};
+#endif
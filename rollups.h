@@ -0,0 +1,154 @@
+#pragma once
+// Cascading multi-resolution rollups (1 s / 10 s / 1 min / 1 h) per camera.
+// Base samples from Camera::run feed the finest level; every bucket that
+// closes at one level is merged into the next coarser one, so all resolutions
+// come from the same counter stream. Each level keeps its history in a
+// fixed-size ring allocated once, queried through the control socket.
+#include <algorithm>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+struct RollupBucket {
+    int64_t start_ms;
+    float min_fps;
+    float max_fps;
+    float avg_fps;   // Weighted by the time each sample covers
+    uint32_t stalls; // Base samples with 0 FPS
+    uint64_t bytes;
+};
+
+struct RollupLevel {
+    int64_t resolution_ms;
+    size_t capacity;
+};
+
+// 2 minutes of 1 s, 1 hour of 10 s, 1 day of 1 min and 1 week of 1 h buckets
+constexpr RollupLevel kRollupLevels[] = {
+    {1000, 120},
+    {10 * 1000, 360},
+    {60 * 1000, 1440},
+    {3600 * 1000, 168},
+};
+constexpr size_t kRollupLevelCount = sizeof(kRollupLevels) / sizeof(kRollupLevels[0]);
+
+// A bucket that just closed, reported so outputs can emit it once
+struct RollupRecord {
+    std::string camera;
+    int64_t resolution_ms;
+    RollupBucket bucket;
+};
+
+class RollupRing {
+public:
+    explicit RollupRing(size_t capacity = 0) : buckets(capacity) {}
+
+    void push(const RollupBucket& bucket) {
+        buckets[head] = bucket;
+        head = (head + 1) % buckets.size();
+        count = std::min(count + 1, buckets.size());
+    }
+
+    size_t size() const { return count; }
+
+    // age 0 is the most recently closed bucket
+    const RollupBucket& at(size_t age) const {
+        return buckets[(head + buckets.size() - 1 - age) % buckets.size()];
+    }
+
+private:
+    std::vector<RollupBucket> buckets;
+    size_t head = 0;
+    size_t count = 0;
+};
+
+class RollupSeries {
+public:
+    RollupSeries() = default;
+
+    // Levels finer than the sampling interval would only hold one sample per
+    // several buckets, so they are left disabled.
+    RollupSeries(const std::string& camera, int64_t interval_ms) : camera(camera) {
+        set_interval(interval_ms);
+    }
+
+    // After an interval change; levels that stay enabled keep their history
+    void set_interval(int64_t interval_ms) {
+        std::vector<Level> kept;
+        for (const auto& config : kRollupLevels) {
+            if (config.resolution_ms < interval_ms) {
+                continue;
+            }
+            auto existing = std::find_if(levels.begin(), levels.end(),
+                                         [&](const Level& level) { return level.resolution_ms == config.resolution_ms; });
+            if (existing != levels.end()) {
+                kept.push_back(std::move(*existing));
+            } else {
+                kept.push_back({config.resolution_ms, RollupRing(config.capacity), {}, 0, false});
+            }
+        }
+        levels.swap(kept);
+    }
+
+    void add_sample(int64_t timestamp_ms, int64_t duration_ms, double fps, uint64_t bytes,
+                    std::vector<RollupRecord>& closed) {
+        RollupBucket sample{timestamp_ms, static_cast<float>(fps), static_cast<float>(fps), static_cast<float>(fps),
+                            fps <= 0 ? 1u : 0u, bytes};
+        add(0, sample, duration_ms, closed);
+    }
+
+    // Closed buckets at one resolution, null if that level is disabled
+    const RollupRing* find_ring(int64_t resolution_ms) const {
+        for (const auto& level : levels) {
+            if (level.resolution_ms == resolution_ms) {
+                return &level.ring;
+            }
+        }
+        return nullptr;
+    }
+
+private:
+    struct Level {
+        int64_t resolution_ms;
+        RollupRing ring;
+        RollupBucket open;
+        int64_t covered_ms; // Time covered by the open bucket, for the weighted average
+        bool has_open;
+    };
+
+    void add(size_t index, const RollupBucket& sample, int64_t duration_ms, std::vector<RollupRecord>& closed) {
+        if (index >= levels.size()) {
+            return;
+        }
+        Level& level = levels[index];
+        int64_t start = sample.start_ms / level.resolution_ms * level.resolution_ms;
+        if (level.has_open && start != level.open.start_ms) {
+            RollupBucket done = level.open;
+            int64_t done_ms = level.covered_ms;
+            level.ring.push(done);
+            level.has_open = false;
+            closed.push_back({camera, level.resolution_ms, done});
+            add(index + 1, done, done_ms, closed);
+        }
+        if (!level.has_open) {
+            level.open = sample;
+            level.open.start_ms = start;
+            level.covered_ms = duration_ms;
+            level.has_open = true;
+            return;
+        }
+        RollupBucket& open = level.open;
+        open.min_fps = std::min(open.min_fps, sample.min_fps);
+        open.max_fps = std::max(open.max_fps, sample.max_fps);
+        int64_t covered = level.covered_ms + duration_ms;
+        if (covered > 0) {
+            open.avg_fps = static_cast<float>((open.avg_fps * level.covered_ms + sample.avg_fps * duration_ms) / covered);
+        }
+        open.stalls += sample.stalls;
+        open.bytes += sample.bytes;
+        level.covered_ms = covered;
+    }
+
+    std::string camera;
+    std::vector<Level> levels;
+};
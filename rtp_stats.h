@@ -0,0 +1,237 @@
+#pragma once
+// RTP sequence-number statistics per SSRC: loss, reordering, duplicates and
+// gaps, following the extended sequence number scheme of RFC 3550 A.1.
+// RTCP sender reports add camera clock drift and capture-to-arrival latency.
+#include <algorithm>
+#include <bitset>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+struct RtpIntervalStats {
+    uint64_t expected = 0;
+    uint64_t received = 0;
+    uint64_t lost = 0;
+    uint64_t reordered = 0;
+    uint64_t duplicates = 0;
+    uint64_t gaps = 0; // Sequence discontinuities, each may cover several lost packets
+
+    double loss_pct() const {
+        return expected ? 100.0 * lost / expected : 0.0;
+    }
+
+    void merge(const RtpIntervalStats& other) {
+        expected += other.expected;
+        received += other.received;
+        lost += other.lost;
+        reordered += other.reordered;
+        duplicates += other.duplicates;
+        gaps += other.gaps;
+    }
+};
+
+class RtpSequenceTracker {
+public:
+    static constexpr uint16_t kMaxDropout = 3000;
+    static constexpr uint16_t kMaxMisorder = 100;
+    static constexpr uint32_t kWindow = 1024; // Recently seen sequence numbers, for duplicates
+
+    void on_packet(uint16_t seq) {
+        if (!initialized) {
+            restart(seq);
+            return;
+        }
+        uint16_t delta = static_cast<uint16_t>(seq - max_seq);
+        uint64_t extended_max = cycles + max_seq;
+        if (delta == 0) {
+            interval.duplicates++;
+        } else if (delta < kMaxDropout) {
+            // In order, possibly after a gap
+            if (seq < max_seq) {
+                cycles += 65536;
+            }
+            if (delta > 1) {
+                interval.gaps++;
+            }
+            for (uint32_t i = 1; i < delta && i <= kWindow; ++i) {
+                seen.reset((extended_max + i) % kWindow);
+            }
+            max_seq = seq;
+            mark(cycles + seq);
+        } else if (delta >= 65536 - kMaxMisorder) {
+            // Late packet from within the misorder window
+            uint64_t extended = extended_max - (65536 - delta);
+            if (extended < base) {
+                return;
+            }
+            if (seen.test(extended % kWindow)) {
+                interval.duplicates++;
+            } else {
+                interval.reordered++;
+                mark(extended);
+            }
+        } else {
+            // Large jump: the sender restarted its sequence, e.g. after a reconnect
+            restart(seq);
+        }
+    }
+
+    // Statistics since the previous call
+    RtpIntervalStats take_interval() {
+        RtpIntervalStats result = interval;
+        uint64_t expected = initialized ? cycles + max_seq - base + 1 : 0;
+        result.expected = expected - expected_prior;
+        result.received = received - received_prior;
+        // Late packets counted here may belong to a previous interval's loss
+        result.lost = result.expected > result.received ? result.expected - result.received : 0;
+        expected_prior = expected;
+        received_prior = received;
+        interval = RtpIntervalStats();
+        return result;
+    }
+
+private:
+    void restart(uint16_t seq) {
+        initialized = true;
+        cycles = 0;
+        max_seq = seq;
+        base = seq;
+        received = 0;
+        expected_prior = 0;
+        received_prior = 0;
+        seen.reset();
+        mark(seq);
+    }
+
+    void mark(uint64_t extended) {
+        seen.set(extended % kWindow);
+        received++;
+    }
+
+    bool initialized = false;
+    uint64_t cycles = 0;  // Sequence number wraps, times 65536
+    uint16_t max_seq = 0;
+    uint64_t base = 0;
+    uint64_t received = 0;
+    uint64_t expected_prior = 0;
+    uint64_t received_prior = 0;
+    std::bitset<kWindow> seen;
+    RtpIntervalStats interval;
+};
+
+// Camera clock versus host clock from RTCP sender report (SR) NTP/RTP pairs.
+// Drift is the slope of (RTP media time - host time) over host time, i.e. how
+// fast the timeline a recorder builds from RTP timestamps runs away from the
+// host. Latency maps each frame's RTP timestamp to camera wall-clock time
+// through the latest SR and is only meaningful when the camera is NTP synced.
+class RtcpClockTracker {
+public:
+    static constexpr size_t kReports = 32;        // SRs kept for the drift regression
+    static constexpr size_t kMaxLatencies = 4096; // Per interval
+    static constexpr double kMaxLatency = 10.0;   // Seconds; beyond that the camera clock is not synced
+
+    // ntp is the 64-bit NTP timestamp from the SR, host_s the host wall clock in seconds
+    void on_sender_report(uint64_t ntp, uint32_t rtp_ts, uint32_t clock_rate, double host_s) {
+        if (clock_rate == 0) {
+            return;
+        }
+        if (rate != clock_rate || !has_report) {
+            rate = clock_rate;
+            extended_rtp = rtp_ts;
+            reports.clear();
+        } else {
+            extended_rtp += static_cast<int32_t>(rtp_ts - last_sr_rtp);
+        }
+        has_report = true;
+        last_sr_rtp = rtp_ts;
+        sr_ntp_s = static_cast<double>(ntp >> 32) - kNtpUnixOffset + (ntp & 0xffffffff) / 4294967296.0;
+        if (reports.empty()) {
+            origin_host = host_s;
+            origin_media = extended_rtp / static_cast<double>(rate);
+        }
+        double media = extended_rtp / static_cast<double>(rate) - origin_media;
+        double host = host_s - origin_host;
+        if (reports.size() == kReports) {
+            reports.erase(reports.begin());
+        }
+        reports.push_back({host, media - host});
+    }
+
+    // Called for each RTP packet; the first packet of every frame gives a latency sample
+    void on_rtp(uint32_t rtp_ts, double host_s) {
+        if (!has_report || (has_frame && rtp_ts == last_frame_rtp)) {
+            return;
+        }
+        has_frame = true;
+        last_frame_rtp = rtp_ts;
+        double capture = sr_ntp_s + static_cast<int32_t>(rtp_ts - last_sr_rtp) / static_cast<double>(rate);
+        double latency = host_s - capture;
+        if (std::fabs(latency) < kMaxLatency && latencies.size() < kMaxLatencies) {
+            latencies.push_back(latency * 1000.0);
+        }
+    }
+
+    bool has_sender_report() const { return has_report; }
+
+    // Least-squares slope in parts per million; NaN until the SRs span 10 seconds
+    double drift_ppm() const {
+        if (reports.size() < 3 || reports.back().host - reports.front().host < 10.0) {
+            return NAN;
+        }
+        double n = reports.size(), sx = 0, sy = 0, sxx = 0, sxy = 0;
+        for (const auto& report : reports) {
+            sx += report.host;
+            sy += report.offset;
+            sxx += report.host * report.host;
+            sxy += report.host * report.offset;
+        }
+        double denominator = n * sxx - sx * sx;
+        return denominator > 0 ? (n * sxy - sx * sy) / denominator * 1e6 : NAN;
+    }
+
+    // Latency samples in milliseconds since the previous call
+    std::vector<double> take_latencies() {
+        std::vector<double> result;
+        result.swap(latencies);
+        return result;
+    }
+
+private:
+    static constexpr double kNtpUnixOffset = 2208988800.0; // Seconds from 1900 to 1970
+
+    struct Report {
+        double host;   // Seconds since the first SR
+        double offset; // Media time minus host time, seconds
+    };
+
+    bool has_report = false;
+    uint32_t rate = 0;
+    uint32_t last_sr_rtp = 0;
+    int64_t extended_rtp = 0;
+    double sr_ntp_s = 0.0;
+    double origin_host = 0.0;
+    double origin_media = 0.0;
+    std::vector<Report> reports;
+
+    bool has_frame = false;
+    uint32_t last_frame_rtp = 0;
+    std::vector<double> latencies;
+};
+
+struct RtpStreamStats {
+    static constexpr int kMaxIdleIntervals = 5; // Then the SSRC is forgotten, e.g. after the camera restarted
+
+    RtpSequenceTracker sequence;
+    RtcpClockTracker clock;
+    int idle_intervals = 0; // Consecutive intervals without a packet
+};
+
+// Value at `fraction` of the sorted samples, NaN if there are none
+inline double percentile(std::vector<double>& samples, double fraction) {
+    if (samples.empty()) {
+        return NAN;
+    }
+    size_t index = std::min(samples.size() - 1, static_cast<size_t>(fraction * samples.size()));
+    std::nth_element(samples.begin(), samples.begin() + index, samples.end());
+    return samples[index];
+}
@@ -0,0 +1,159 @@
+#pragma once
+// Minimal local HTTP endpoint for on-demand camera snapshots.
+//
+//   GET /snapshot/<camera>   200 image/jpeg, 404 unknown camera, 503 no image yet
+//   GET /cameras             200 text/plain, one camera name per line
+//
+// Requests are served one at a time on the server's own thread; a snapshot is
+// one keyframe decode, so this is meant for operators and scripts, not for
+// streaming. Binds to 127.0.0.1 only.
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <functional>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+class SnapshotServer {
+public:
+    // Fills jpeg and returns 200, or returns the HTTP error status
+    using SnapshotHandler = std::function<int(const std::string& camera, std::vector<uint8_t>& jpeg)>;
+    using ListHandler = std::function<std::vector<std::string>()>;
+
+    SnapshotServer(int port, SnapshotHandler snapshot, ListHandler list)
+        : port(port), snapshot(std::move(snapshot)), list(std::move(list)) {}
+
+    ~SnapshotServer() { stop(); }
+
+    bool start() {
+        listen_fd = ::socket(AF_INET, SOCK_STREAM, 0);
+        if (listen_fd < 0) {
+            std::cerr << "Could not create snapshot socket: " << std::strerror(errno) << std::endl;
+            return false;
+        }
+        int reuse = 1;
+        setsockopt(listen_fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+        sockaddr_in address{};
+        address.sin_family = AF_INET;
+        address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        address.sin_port = htons(static_cast<uint16_t>(port));
+        if (::bind(listen_fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) < 0 || ::listen(listen_fd, 8) < 0) {
+            std::cerr << "Could not listen on 127.0.0.1:" << port << ": " << std::strerror(errno) << std::endl;
+            ::close(listen_fd);
+            listen_fd = -1;
+            return false;
+        }
+        std::cout << "Snapshots served at http://127.0.0.1:" << port << "/snapshot/<camera>" << std::endl;
+        worker = std::thread(&SnapshotServer::run, this);
+        return true;
+    }
+
+    void stop() {
+        if (listen_fd < 0) {
+            return;
+        }
+        stopping = true;
+        // Wakes the accept() call
+        ::shutdown(listen_fd, SHUT_RDWR);
+        if (worker.joinable()) {
+            worker.join();
+        }
+        ::close(listen_fd);
+        listen_fd = -1;
+    }
+
+private:
+    void run() {
+        while (!stopping) {
+            int fd = ::accept(listen_fd, nullptr, nullptr);
+            if (fd < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                return;
+            }
+            // A stuck client must not hold up the next request for long
+            timeval timeout{5, 0};
+            setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+            setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+            serve(fd);
+            ::close(fd);
+        }
+    }
+
+    void serve(int fd) {
+        // Only the request line matters; headers are read and ignored
+        std::string request;
+        char chunk[1024];
+        while (request.find("\r\n\r\n") == std::string::npos && request.size() < 8192) {
+            ssize_t received = ::recv(fd, chunk, sizeof(chunk), 0);
+            if (received <= 0) {
+                break;
+            }
+            request.append(chunk, received);
+        }
+        size_t line_end = request.find("\r\n");
+        std::string line = request.substr(0, line_end);
+        size_t path_start = line.find(' ');
+        size_t path_end = line.find(' ', path_start + 1);
+        if (line.compare(0, 4, "GET ") != 0 || path_end == std::string::npos) {
+            respond(fd, 400, "text/plain", "Bad request\n");
+            return;
+        }
+        std::string path = line.substr(path_start + 1, path_end - path_start - 1);
+
+        const std::string prefix = "/snapshot/";
+        if (path == "/cameras") {
+            std::string body;
+            for (const auto& name : list()) {
+                body += name + "\n";
+            }
+            respond(fd, 200, "text/plain", body);
+        } else if (path.compare(0, prefix.size(), prefix) == 0 && path.size() > prefix.size()) {
+            std::vector<uint8_t> jpeg;
+            int status = snapshot(path.substr(prefix.size()), jpeg);
+            if (status == 200) {
+                respond(fd, 200, "image/jpeg", std::string(jpeg.begin(), jpeg.end()));
+            } else {
+                respond(fd, status, "text/plain", status == 404 ? "Unknown camera\n" : "No image available yet\n");
+            }
+        } else {
+            respond(fd, 404, "text/plain", "Not found\n");
+        }
+    }
+
+    static void respond(int fd, int status, const std::string& type, const std::string& body) {
+        const char* reason = status == 200 ? "OK" : status == 400 ? "Bad Request" : status == 404 ? "Not Found"
+                                                                                             : "Service Unavailable";
+        std::string header = "HTTP/1.0 " + std::to_string(status) + " " + reason + "\r\nContent-Type: " + type
+                             + "\r\nContent-Length: " + std::to_string(body.size())
+                             + "\r\nCache-Control: no-store\r\nConnection: close\r\n\r\n";
+        send_all(fd, header.data(), header.size());
+        send_all(fd, body.data(), body.size());
+    }
+
+    static void send_all(int fd, const char* data, size_t size) {
+        while (size > 0) {
+            ssize_t sent = ::send(fd, data, size, MSG_NOSIGNAL);
+            if (sent <= 0) {
+                return;
+            }
+            data += sent;
+            size -= sent;
+        }
+    }
+
+    int port;
+    SnapshotHandler snapshot;
+    ListHandler list;
+    int listen_fd = -1;
+    std::atomic<bool> stopping{false};
+    std::thread worker;
+};
@@ -0,0 +1,215 @@
+#pragma once
+// Last-frame-age watchdog driven by a hierarchical timing wheel.
+//
+// The frame path only stores the arrival time of each frame into an atomic.
+// Every camera has one timer in the wheel, due when its last known frame gets
+// older than the camera's stall timeout. When a timer fires the watchdog looks
+// at the real last-arrival time and either re-arms the timer (frames kept
+// coming) or reports a stall, so the cost is O(1) per camera per timeout rather
+// than per frame, and detection latency is the timeout plus one wheel tick.
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+
+struct TimerNode {
+    TimerNode* prev = nullptr;
+    TimerNode* next = nullptr;
+    uint64_t expires = 0; // In wheel ticks
+};
+
+// Three levels of 256 slots, Linux timer-wheel style: timers sit in the
+// coarsest level that can hold them and cascade down as time approaches.
+class TimingWheel {
+public:
+    static constexpr int kLevels = 3;
+    static constexpr int kSlotBits = 8;
+    static constexpr uint64_t kSlots = 1 << kSlotBits;
+    static constexpr uint64_t kMask = kSlots - 1;
+
+    explicit TimingWheel(uint64_t now) : current(now) {
+        for (auto& level : slots) {
+            for (auto& head : level) {
+                head.prev = head.next = &head;
+            }
+        }
+    }
+
+    void schedule(TimerNode* timer, uint64_t expires) {
+        cancel(timer);
+        // Past or too distant deadlines are clamped into the wheel's range
+        if (expires <= current) {
+            expires = current + 1;
+        }
+        uint64_t max = current + (1ull << (kSlotBits * kLevels)) - 1;
+        if (expires > max) {
+            expires = max;
+        }
+        timer->expires = expires;
+        insert(timer);
+    }
+
+    void cancel(TimerNode* timer) {
+        if (timer->next) {
+            timer->prev->next = timer->next;
+            timer->next->prev = timer->prev;
+            timer->prev = timer->next = nullptr;
+        }
+    }
+
+    // Advances to `now`, calling fire(timer) for each expired timer. The callback
+    // may schedule the timer again.
+    template <typename Fire>
+    void advance(uint64_t now, Fire fire) {
+        while (current < now) {
+            ++current;
+            // Entering a new lap of a level pulls its next slot down into finer
+            // levels, coarsest first so cascaded timers can cascade again
+            int top = 0;
+            while (top + 1 < kLevels && (current & ((1ull << (kSlotBits * (top + 1))) - 1)) == 0) {
+                ++top;
+            }
+            for (int level = top; level >= 1; --level) {
+                cascade(level, (current >> (kSlotBits * level)) & kMask);
+            }
+            TimerNode& head = slots[0][current & kMask];
+            while (head.next != &head) {
+                TimerNode* timer = head.next;
+                cancel(timer);
+                fire(timer);
+            }
+        }
+    }
+
+private:
+    void insert(TimerNode* timer) {
+        uint64_t delta = timer->expires - current;
+        int level = 0;
+        while (level < kLevels - 1 && delta >= (1ull << (kSlotBits * (level + 1)))) {
+            ++level;
+        }
+        TimerNode& head = slots[level][(timer->expires >> (kSlotBits * level)) & kMask];
+        timer->prev = head.prev;
+        timer->next = &head;
+        head.prev->next = timer;
+        head.prev = timer;
+    }
+
+    void cascade(int level, uint64_t index) {
+        TimerNode& head = slots[level][index];
+        while (head.next != &head) {
+            TimerNode* timer = head.next;
+            cancel(timer);
+            insert(timer);
+        }
+    }
+
+    uint64_t current;
+    TimerNode slots[kLevels][kSlots];
+};
+
+// Per-camera watch entry. The owner fills in the callbacks and timeout before
+// adding it to the watchdog; both callbacks run on the watchdog thread.
+struct StallWatch : TimerNode {
+    std::string name;
+    int64_t timeout_ns = 0;
+    std::atomic<int64_t> last_frame_ns{0}; // Steady clock, written for every frame
+    std::atomic<int64_t> armed_ns{0};      // (Re)start time, counts as a frame for the first timeout
+    std::atomic<bool> stalled{false};
+    std::atomic<uint32_t> stalls{0};
+    std::function<void(int64_t age_ns)> on_stall; // Called on every check while stalled
+    std::function<void()> on_recover;
+
+    int64_t last_seen_ns() const {
+        int64_t frame = last_frame_ns.load(std::memory_order_relaxed);
+        int64_t armed = armed_ns.load(std::memory_order_relaxed);
+        return frame > armed ? frame : armed;
+    }
+};
+
+inline int64_t steady_now_ns() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+class StallWatchdog {
+public:
+    static constexpr int64_t kTickNs = 10 * 1000000; // 10 ms wheel resolution
+
+    StallWatchdog() : wheel(steady_now_ns() / kTickNs) {}
+
+    ~StallWatchdog() { stop(); }
+
+    void start() {
+        worker = std::thread(&StallWatchdog::run, this);
+    }
+
+    void stop() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        cv.notify_one();
+        if (worker.joinable()) {
+            worker.join();
+        }
+    }
+
+    void add(StallWatch* watch) {
+        std::lock_guard<std::mutex> lock(mutex);
+        wheel.schedule(watch, due_tick(watch->last_seen_ns() + watch->timeout_ns));
+    }
+
+    void remove(StallWatch* watch) {
+        std::lock_guard<std::mutex> lock(mutex);
+        wheel.cancel(watch);
+    }
+
+private:
+    static uint64_t due_tick(int64_t deadline_ns) {
+        // Round up so a timer never fires before its deadline
+        return (deadline_ns + kTickNs - 1) / kTickNs;
+    }
+
+    void run() {
+        std::unique_lock<std::mutex> lock(mutex);
+        auto next = std::chrono::steady_clock::now();
+        while (!stopping) {
+            next += std::chrono::nanoseconds(kTickNs);
+            if (cv.wait_until(lock, next, [this] { return stopping; })) {
+                break;
+            }
+            int64_t now = steady_now_ns();
+            wheel.advance(now / kTickNs, [&](TimerNode* node) { check(static_cast<StallWatch*>(node), now); });
+        }
+    }
+
+    void check(StallWatch* watch, int64_t now) {
+        int64_t age = now - watch->last_seen_ns();
+        if (age >= watch->timeout_ns) {
+            if (!watch->stalled.exchange(true, std::memory_order_relaxed)) {
+                watch->stalls.fetch_add(1, std::memory_order_relaxed);
+            }
+            if (watch->on_stall) {
+                watch->on_stall(age);
+            }
+            // Keep checking once per timeout to notice recovery and retry reconnects
+            wheel.schedule(watch, due_tick(now + watch->timeout_ns));
+            return;
+        }
+        if (watch->stalled.exchange(false, std::memory_order_relaxed) && watch->on_recover) {
+            watch->on_recover();
+        }
+        wheel.schedule(watch, due_tick(watch->last_seen_ns() + watch->timeout_ns));
+    }
+
+    std::mutex mutex; // Guards the wheel; held by the watchdog thread while it advances
+    std::condition_variable cv;
+    TimingWheel wheel;
+    bool stopping = false;
+    std::thread worker;
+};
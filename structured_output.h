@@ -0,0 +1,366 @@
+#pragma once
+// JSON Lines / CSV output of per-tick snapshots.
+// Formatting and file I/O happen on a dedicated writer thread; the ticking
+// thread only enqueues a shared pointer, so a slow disk or pipe never holds
+// fps_mutex.
+#include "metrics_snapshot.h"
+#include <cmath>
+#include <condition_variable>
+#include <cstdio>
+#include <ctime>
+#include <deque>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <thread>
+
+enum class OutputFormat { JsonLines, Csv };
+
+class StructuredWriter {
+public:
+    // path "-" writes to stdout and disables rotation.
+    // rotate_bytes / rotate_seconds of 0 disable the corresponding rotation.
+    StructuredWriter(OutputFormat format, const std::string& path, Estimator estimator, size_t rotate_bytes,
+                     int rotate_seconds)
+        : format(format), path(path), estimator(estimator), rotate_bytes(rotate_bytes),
+          rotate_seconds(rotate_seconds) {}
+
+    ~StructuredWriter() { stop(); }
+
+    bool start() {
+        if (!open_file()) {
+            return false;
+        }
+        worker = std::thread(&StructuredWriter::run, this);
+        return true;
+    }
+
+    void stop() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (stopping) {
+                return;
+            }
+            stopping = true;
+        }
+        cv.notify_one();
+        if (worker.joinable()) {
+            worker.join();
+        }
+        close_file();
+    }
+
+    // Called once per tick. Never blocks on I/O; drops the oldest snapshot if the
+    // writer has fallen too far behind.
+    void submit(SnapshotPtr snapshot) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (queue.size() >= kMaxQueued) {
+                queue.pop_front();
+                ++dropped;
+            }
+            queue.push_back(std::move(snapshot));
+        }
+        cv.notify_one();
+    }
+
+private:
+    static constexpr size_t kMaxQueued = 256;
+
+    void run() {
+        std::deque<SnapshotPtr> batch;
+        std::string buffer;
+        for (;;) {
+            size_t lost = 0;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                cv.wait(lock, [this] { return stopping || !queue.empty(); });
+                if (queue.empty() && stopping) {
+                    return;
+                }
+                batch.swap(queue);
+                lost = dropped;
+                dropped = 0;
+            }
+
+            if (lost > 0) {
+                std::cerr << "Structured output fell behind, dropped " << lost << " snapshots" << std::endl;
+            }
+
+            // Format the whole batch, then hand it to the file in a single write
+            buffer.clear();
+            for (const auto& snapshot : batch) {
+                append(buffer, *snapshot);
+            }
+            batch.clear();
+
+            rotate_if_needed(buffer.size());
+            if (file && std::fwrite(buffer.data(), 1, buffer.size(), file) != buffer.size()) {
+                std::cerr << "Failed to write structured output to: " << path << std::endl;
+            }
+            if (file) {
+                std::fflush(file);
+            }
+            written += buffer.size();
+        }
+    }
+
+    void append(std::string& out, const MetricsSnapshot& snapshot) const {
+        std::string timestamp = format_time(snapshot.timestamp_ms);
+        for (const auto& camera : snapshot.cameras) {
+            if (format == OutputFormat::JsonLines) {
+                out += "{\"ts\":\"" + timestamp + "\",\"camera\":\"";
+                append_json_escaped(out, camera.name);
+                out += "\",\"fps\":" + format_fps(camera);
+                out += ",\"downtime\":" + std::to_string(camera.downtime);
+                out += ",\"bitrate_kbps\":" + format_number(camera.bitrate_kbps);
+                out += ",\"jitter_ms\":" + format_number(camera.jitter_ms);
+                out += ",\"stalled\":" + std::string(camera.stalled ? "true" : "false");
+                out += ",\"frozen\":" + std::string(camera.frozen ? "true" : "false");
+                out += ",\"frame_age_ms\":" + format_number(camera.frame_age_ms);
+                out += ",\"loss_pct\":" + format_number(camera.rtp.loss_pct());
+                out += ",\"packets_expected\":" + std::to_string(camera.rtp.expected);
+                out += ",\"packets_lost\":" + std::to_string(camera.rtp.lost);
+                out += ",\"packets_reordered\":" + std::to_string(camera.rtp.reordered);
+                out += ",\"packets_duplicate\":" + std::to_string(camera.rtp.duplicates);
+                out += ",\"drift_ppm\":" + format_optional(camera.drift_ppm);
+                out += ",\"latency_p50_ms\":" + format_optional(camera.latency_p50_ms);
+                out += ",\"latency_p95_ms\":" + format_optional(camera.latency_p95_ms);
+                out += ",\"latency_p99_ms\":" + format_optional(camera.latency_p99_ms);
+                out += ",\"codec\":" + json_string(camera.stream.codec);
+                out += ",\"profile\":" + json_string(camera.stream.profile);
+                out += ",\"level\":" + json_string(camera.stream.level);
+                out += ",\"width\":" + std::to_string(camera.stream.width);
+                out += ",\"height\":" + std::to_string(camera.stream.height);
+                out += ",\"framerate\":" + format_number(camera.stream.framerate);
+                out += ",\"stream_format\":" + json_string(camera.stream.stream_format);
+                out += ",\"caps_changes\":" + std::to_string(camera.caps_changes);
+                out += ",\"parameter_set_changes\":" + std::to_string(camera.parameter_set_changes);
+                out += ",\"idr_frames\":" + std::to_string(camera.frame_types.idr);
+                out += ",\"intra_frames\":" + std::to_string(camera.frame_types.intra);
+                out += ",\"p_frames\":" + std::to_string(camera.frame_types.p);
+                out += ",\"b_frames\":" + std::to_string(camera.frame_types.b);
+                out += ",\"sei_nals\":" + std::to_string(camera.frame_types.sei);
+                out += ",\"parameter_set_nals\":" + std::to_string(camera.frame_types.parameter_sets);
+                if (camera.image.valid) {
+                    out += ",\"image_state\":" + json_string(camera.image.state);
+                    out += ",\"mean_luma\":" + format_number(camera.image.mean_luma);
+                    out += ",\"luma_stddev\":" + format_number(camera.image.luma_stddev);
+                    out += ",\"blur_score\":" + format_number(camera.image.blur_score);
+                } else {
+                    out += ",\"image_state\":null,\"mean_luma\":null,\"luma_stddev\":null,\"blur_score\":null";
+                }
+                out += ",\"scene_distance\":" + (camera.scene.valid ? std::to_string(camera.scene.distance) : "null");
+                out += ",\"camera_moved\":" + std::string(camera.scene.moved ? "true" : "false");
+                out += ",\"relay_clients\":" + std::to_string(camera.relay_clients);
+                out += ",\"relay_egress_kbps\":" + format_number(camera.relay_egress_kbps);
+                if (camera.duplicate_group.empty()) {
+                    out += ",\"duplicate_group\":null";
+                } else {
+                    out += ",\"duplicate_group\":" + json_string(camera.duplicate_group);
+                }
+                out += ",\"tracks\":[";
+                for (size_t i = 0; i < camera.tracks.size(); ++i) {
+                    const TrackSample& track = camera.tracks[i];
+                    out += i ? ",{\"track\":" : "{\"track\":";
+                    out += json_string(track.track) + ",\"media\":" + json_string(track.media);
+                    out += ",\"encoding\":" + json_string(track.encoding);
+                    out += ",\"rate\":" + format_number(track.rate);
+                    out += ",\"packet_rate\":" + format_number(track.packet_rate);
+                    out += ",\"bitrate_kbps\":" + format_number(track.bitrate_kbps);
+                    out += ",\"age_ms\":" + format_number(track.age_ms) + "}";
+                }
+                out += "]";
+                out += "}\n";
+            } else {
+                out += timestamp + "," + csv_field(camera.name) + "," + format_fps(camera) + ","
+                       + std::to_string(camera.downtime) + "," + format_number(camera.bitrate_kbps) + ","
+                       + format_number(camera.jitter_ms) + "," + (camera.stalled ? "1" : "0") + ","
+                       + format_number(camera.frame_age_ms) + "," + format_number(camera.rtp.loss_pct()) + ","
+                       + std::to_string(camera.rtp.lost) + "," + std::to_string(camera.rtp.reordered) + ","
+                       + std::to_string(camera.rtp.duplicates) + "," + format_optional(camera.drift_ppm) + ","
+                       + format_optional(camera.latency_p50_ms) + "," + format_optional(camera.latency_p95_ms) + ","
+                       + format_optional(camera.latency_p99_ms) + "," + csv_field(camera.stream.codec) + ","
+                       + csv_field(camera.stream.profile) + "," + csv_field(camera.stream.level) + "," + std::to_string(camera.stream.width) + ","
+                       + std::to_string(camera.stream.height) + "," + format_number(camera.stream.framerate) + ","
+                       + csv_field(camera.stream.stream_format) + "," + std::to_string(camera.caps_changes) + ","
+                       + std::to_string(camera.parameter_set_changes) + "," + (camera.frozen ? "1" : "0") + ","
+                       + std::to_string(camera.frame_types.idr) + "," + std::to_string(camera.frame_types.intra) + ","
+                       + std::to_string(camera.frame_types.p) + "," + std::to_string(camera.frame_types.b) + ","
+                       + std::to_string(camera.frame_types.sei) + "," + std::to_string(camera.frame_types.parameter_sets) + ","
+                       + csv_field(camera.image.state) + "," + format_optional(camera.image.valid ? camera.image.mean_luma : NAN) + ","
+                       + format_optional(camera.image.valid ? camera.image.luma_stddev : NAN) + ","
+                       + format_optional(camera.image.valid ? camera.image.blur_score : NAN) + ","
+                       + (camera.scene.valid ? std::to_string(camera.scene.distance) : "") + ","
+                       + (camera.scene.moved ? "1" : "0") + "," + csv_field(camera.duplicate_group) + ","
+                       + std::to_string(camera.relay_clients) + "," + format_number(camera.relay_egress_kbps) + "\n";
+            }
+        }
+        // Rollups and events only fit the JSON schema; CSV keeps one fixed column set
+        if (format == OutputFormat::JsonLines) {
+            for (const auto& event : snapshot.events) {
+                out += "{\"ts\":\"" + format_time(event.timestamp_ms) + "\",\"camera\":\"";
+                append_json_escaped(out, event.camera);
+                out += "\",\"event\":\"";
+                append_json_escaped(out, event.kind);
+                out += "_change\",\"detail\":\"";
+                append_json_escaped(out, event.detail);
+                out += "\"}\n";
+            }
+            for (const auto& rollup : snapshot.rollups) {
+                out += "{\"ts\":\"" + format_time(rollup.bucket.start_ms) + "\",\"camera\":\"";
+                append_json_escaped(out, rollup.camera);
+                out += "\",\"rollup_s\":" + std::to_string(rollup.resolution_ms / 1000);
+                out += ",\"min_fps\":" + format_number(rollup.bucket.min_fps);
+                out += ",\"avg_fps\":" + format_number(rollup.bucket.avg_fps);
+                out += ",\"max_fps\":" + format_number(rollup.bucket.max_fps);
+                out += ",\"bytes\":" + std::to_string(rollup.bucket.bytes);
+                out += ",\"stalls\":" + std::to_string(rollup.bucket.stalls);
+                out += "}\n";
+            }
+        }
+    }
+
+    static void append_json_escaped(std::string& out, const std::string& value) {
+        for (char c : value) {
+            if (c == '"' || c == '\\') {
+                out += '\\';
+                out += c;
+            } else if (static_cast<unsigned char>(c) < 0x20) {
+                char escaped[8];
+                std::snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+                out += escaped;
+            } else {
+                out += c;
+            }
+        }
+    }
+
+    static std::string json_string(const std::string& value) {
+        std::string quoted = "\"";
+        append_json_escaped(quoted, value);
+        return quoted + "\"";
+    }
+
+    // RFC 4180: fields with a comma, quote or line break are quoted, quotes doubled
+    static std::string csv_field(const std::string& value) {
+        if (value.find_first_of(",\"\r\n") == std::string::npos) {
+            return value;
+        }
+        std::string quoted = "\"";
+        for (char c : value) {
+            if (c == '"') {
+                quoted += '"';
+            }
+            quoted += c;
+        }
+        return quoted + "\"";
+    }
+
+    std::string format_fps(const CameraSample& camera) const {
+        return format_number(estimate(camera, estimator));
+    }
+
+    // Values that may be unknown (NaN): null in JSON, empty in CSV
+    std::string format_optional(double value) const {
+        if (std::isnan(value)) {
+            return format == OutputFormat::JsonLines ? "null" : "";
+        }
+        return format_number(value);
+    }
+
+    static std::string format_number(double value) {
+        char text[32];
+        std::snprintf(text, sizeof(text), "%.2f", value);
+        return text;
+    }
+
+    // ISO 8601 UTC with milliseconds, e.g. 2024-05-01T12:00:00.250Z
+    static std::string format_time(int64_t timestamp_ms) {
+        std::time_t seconds = timestamp_ms / 1000;
+        std::tm utc;
+        gmtime_r(&seconds, &utc);
+        char text[32];
+        size_t len = std::strftime(text, sizeof(text), "%Y-%m-%dT%H:%M:%S", &utc);
+        std::snprintf(text + len, sizeof(text) - len, ".%03dZ", static_cast<int>(timestamp_ms % 1000));
+        return text;
+    }
+
+    bool open_file() {
+        if (path == "-") {
+            file = stdout;
+        } else {
+            file = std::fopen(path.c_str(), "a");
+            if (!file) {
+                std::cerr << "Could not open structured output file: " << path << std::endl;
+                return false;
+            }
+            std::fseek(file, 0, SEEK_END);
+            written = std::ftell(file);
+        }
+        opened_at = std::time(nullptr);
+        if (format == OutputFormat::Csv && written == 0) {
+            static const std::string header = "timestamp,camera,fps,downtime,bitrate_kbps,jitter_ms,stalled,frame_age_ms,loss_pct,packets_lost,packets_reordered,packets_duplicate,drift_ppm,"
+                                              "latency_p50_ms,latency_p95_ms,latency_p99_ms,codec,profile,level,width,height,framerate,stream_format,"
+                                              "caps_changes,parameter_set_changes,frozen,"
+                                              "idr_frames,intra_frames,p_frames,b_frames,sei_nals,parameter_set_nals,"
+                                              "image_state,mean_luma,luma_stddev,blur_score,scene_distance,camera_moved,duplicate_group,relay_clients,relay_egress_kbps\n";
+            std::fwrite(header.data(), 1, header.size(), file);
+            written = header.size();
+        }
+        return true;
+    }
+
+    void close_file() {
+        if (file && file != stdout) {
+            std::fclose(file);
+        }
+        file = nullptr;
+    }
+
+    void rotate_if_needed(size_t incoming) {
+        if (file == stdout || !file) {
+            return;
+        }
+        bool too_big = rotate_bytes > 0 && written > 0 && written + incoming > rotate_bytes;
+        bool too_old = rotate_seconds > 0 && std::time(nullptr) - opened_at >= rotate_seconds;
+        if (!too_big && !too_old) {
+            return;
+        }
+
+        close_file();
+        std::time_t now = std::time(nullptr);
+        std::tm local;
+        localtime_r(&now, &local);
+        char suffix[32];
+        std::strftime(suffix, sizeof(suffix), ".%Y%m%d-%H%M%S", &local);
+        std::string rotated = path + suffix;
+        // Several rotations within one second must not overwrite each other
+        for (int n = 1; std::FILE* existing = std::fopen(rotated.c_str(), "r"); ++n) {
+            std::fclose(existing);
+            rotated = path + suffix + "-" + std::to_string(n);
+        }
+        if (std::rename(path.c_str(), rotated.c_str()) != 0) {
+            std::cerr << "Failed to rotate structured output file: " << path << std::endl;
+        }
+        written = 0;
+        open_file();
+    }
+
+    OutputFormat format;
+    std::string path;
+    Estimator estimator;
+    size_t rotate_bytes;
+    int rotate_seconds;
+
+    std::FILE* file = nullptr;
+    size_t written = 0;
+    std::time_t opened_at = 0;
+
+    std::mutex mutex;
+    std::condition_variable cv;
+    std::deque<SnapshotPtr> queue;
+    size_t dropped = 0;
+    bool stopping = false;
+    std::thread worker;
+};
@@ -0,0 +1,596 @@
+#pragma once
+// Append-only, memory-mapped time-series store for per-camera metrics history.
+//
+// One file per day (<dir>/YYYYMMDD.fts). Each camera accumulates samples in an
+// in-memory block compressed Gorilla style: delta-of-delta timestamps and
+// XOR-compressed values. Blocks are appended to the mapped file as records
+// once full or a minute old; the committed length in the file header is only
+// advanced after a record is completely written, so readers never see a torn
+// record, and a killed process loses at most the last minute.
+#include "metrics_snapshot.h"
+#include <atomic>
+#include <cmath>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <ctime>
+#include <iostream>
+#include <map>
+#include <string>
+#include <vector>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace tsdb {
+
+constexpr char kMagic[8] = {'F', 'P', 'S', 'T', 'S', 'D', 'B', '1'};
+constexpr uint32_t kVersion = 1;
+constexpr size_t kBlockBytes = 4096;         // Close a block once its payload reaches this size
+constexpr int64_t kBlockSpanMs = 60 * 1000;  // ... or once it spans a minute, the most a crash can lose
+constexpr size_t kGrowBytes = 4 << 20;       // File is extended in 4 MB steps
+
+enum RecordType : uint32_t { kCameraRecord = 1, kBlockRecord = 2 };
+
+struct FileHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t pad;
+    std::atomic<uint64_t> committed; // Bytes of valid data, header included
+    int64_t created_ms;
+    uint8_t reserved[32];
+};
+
+struct RecordHeader {
+    uint32_t type;
+    uint32_t camera_id;
+    uint32_t size;   // Payload bytes following this header
+    uint32_t count;  // Samples in a block record
+    int64_t first_ms;
+    int64_t last_ms;
+};
+
+static_assert(sizeof(FileHeader) == 64, "tsdb file header layout changed");
+static_assert(sizeof(RecordHeader) == 32, "tsdb record header layout changed");
+
+struct Point {
+    int64_t timestamp_ms;
+    double fps;
+    double bitrate_kbps;
+    double jitter_ms;
+};
+
+constexpr int kValueCount = 3;
+
+class BitWriter {
+public:
+    void write(uint64_t value, int bits) {
+        while (bits > 0) {
+            if (used == 0) {
+                bytes.push_back(0);
+                used = 8;
+            }
+            int take = bits < used ? bits : used;
+            uint8_t chunk = static_cast<uint8_t>((value >> (bits - take)) & ((1u << take) - 1));
+            bytes.back() |= static_cast<uint8_t>(chunk << (used - take));
+            used -= take;
+            bits -= take;
+        }
+    }
+
+    size_t size() const { return bytes.size(); }
+    const std::vector<uint8_t>& data() const { return bytes; }
+    void clear() { bytes.clear(); used = 0; }
+
+private:
+    std::vector<uint8_t> bytes;
+    int used = 0; // Free bits left in the last byte
+};
+
+class BitReader {
+public:
+    BitReader(const uint8_t* data, size_t size) : data(data), size(size) {}
+
+    bool read(int bits, uint64_t& value) {
+        value = 0;
+        while (bits > 0) {
+            if (pos >= size * 8) {
+                return false;
+            }
+            int available = 8 - static_cast<int>(pos % 8);
+            int take = bits < available ? bits : available;
+            uint8_t byte = data[pos / 8];
+            uint64_t chunk = (byte >> (available - take)) & ((1u << take) - 1);
+            value = (value << take) | chunk;
+            pos += take;
+            bits -= take;
+        }
+        return true;
+    }
+
+private:
+    const uint8_t* data;
+    size_t size;
+    size_t pos = 0;
+};
+
+// XOR compression state for one value column (Gorilla section 4.1.2)
+struct XorState {
+    uint64_t previous = 0;
+    int leading = -1;
+    int trailing = 0;
+};
+
+inline uint64_t to_bits(double value) {
+    uint64_t bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+    return bits;
+}
+
+inline double from_bits(uint64_t bits) {
+    double value;
+    std::memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+inline void encode_value(BitWriter& out, XorState& state, double value) {
+    uint64_t bits = to_bits(value);
+    uint64_t x = bits ^ state.previous;
+    state.previous = bits;
+    if (x == 0) {
+        out.write(0, 1);
+        return;
+    }
+    int leading = __builtin_clzll(x);
+    int trailing = __builtin_ctzll(x);
+    if (leading > 31) {
+        leading = 31;
+    }
+    if (state.leading >= 0 && leading >= state.leading && trailing >= state.trailing) {
+        // Meaningful bits fit in the previous window
+        out.write(0b10, 2);
+        out.write(x >> state.trailing, 64 - state.leading - state.trailing);
+        return;
+    }
+    int meaningful = 64 - leading - trailing;
+    out.write(0b11, 2);
+    out.write(leading, 5);
+    out.write(meaningful == 64 ? 0 : meaningful, 6);
+    out.write(x >> trailing, meaningful);
+    state.leading = leading;
+    state.trailing = trailing;
+}
+
+inline bool decode_value(BitReader& in, XorState& state, double& value) {
+    uint64_t control;
+    if (!in.read(1, control)) {
+        return false;
+    }
+    if (control == 0) {
+        value = from_bits(state.previous);
+        return true;
+    }
+    if (!in.read(1, control)) {
+        return false;
+    }
+    if (control == 1) {
+        uint64_t leading, meaningful;
+        if (!in.read(5, leading) || !in.read(6, meaningful)) {
+            return false;
+        }
+        if (meaningful == 0) {
+            meaningful = 64;
+        }
+        state.leading = static_cast<int>(leading);
+        state.trailing = 64 - static_cast<int>(leading) - static_cast<int>(meaningful);
+    }
+    uint64_t x;
+    if (!in.read(64 - state.leading - state.trailing, x)) {
+        return false;
+    }
+    state.previous ^= x << state.trailing;
+    value = from_bits(state.previous);
+    return true;
+}
+
+// Delta-of-delta timestamp buckets (Gorilla section 4.1.1, in milliseconds)
+inline void encode_dod(BitWriter& out, int64_t dod) {
+    if (dod == 0) {
+        out.write(0, 1);
+    } else if (dod >= -63 && dod <= 64) {
+        out.write(0b10, 2);
+        out.write(static_cast<uint64_t>(dod + 63), 7);
+    } else if (dod >= -255 && dod <= 256) {
+        out.write(0b110, 3);
+        out.write(static_cast<uint64_t>(dod + 255), 9);
+    } else if (dod >= -2047 && dod <= 2048) {
+        out.write(0b1110, 4);
+        out.write(static_cast<uint64_t>(dod + 2047), 12);
+    } else {
+        out.write(0b1111, 4);
+        out.write(static_cast<uint32_t>(static_cast<int32_t>(dod)), 32);
+    }
+}
+
+inline bool decode_dod(BitReader& in, int64_t& dod) {
+    uint64_t bit, raw;
+    int prefix = 0;
+    while (prefix < 4) {
+        if (!in.read(1, bit)) {
+            return false;
+        }
+        if (bit == 0) {
+            break;
+        }
+        ++prefix;
+    }
+    switch (prefix) {
+        case 0: dod = 0; return true;
+        case 1: if (!in.read(7, raw)) return false; dod = static_cast<int64_t>(raw) - 63; return true;
+        case 2: if (!in.read(9, raw)) return false; dod = static_cast<int64_t>(raw) - 255; return true;
+        case 3: if (!in.read(12, raw)) return false; dod = static_cast<int64_t>(raw) - 2047; return true;
+        default: if (!in.read(32, raw)) return false; dod = static_cast<int32_t>(static_cast<uint32_t>(raw)); return true;
+    }
+}
+
+// Open block of one camera
+class BlockEncoder {
+public:
+    void append(const Point& point) {
+        double values[kValueCount] = {point.fps, point.bitrate_kbps, point.jitter_ms};
+        if (count == 0) {
+            first_ms = point.timestamp_ms;
+            for (int i = 0; i < kValueCount; ++i) {
+                bits.write(to_bits(values[i]), 64);
+                columns[i].previous = to_bits(values[i]);
+            }
+        } else {
+            int64_t delta = point.timestamp_ms - last_ms;
+            encode_dod(bits, delta - last_delta);
+            last_delta = delta;
+            for (int i = 0; i < kValueCount; ++i) {
+                encode_value(bits, columns[i], values[i]);
+            }
+        }
+        last_ms = point.timestamp_ms;
+        ++count;
+    }
+
+    // The block must be closed before a timestamp that cannot be delta encoded
+    bool accepts(int64_t timestamp_ms) const {
+        if (count == 0) {
+            return true;
+        }
+        int64_t dod = (timestamp_ms - last_ms) - last_delta;
+        return timestamp_ms > last_ms && dod > INT32_MIN && dod < INT32_MAX
+               && bits.size() < kBlockBytes && timestamp_ms - first_ms < kBlockSpanMs;
+    }
+
+    void reset() {
+        *this = BlockEncoder();
+    }
+
+    uint32_t count = 0;
+    int64_t first_ms = 0;
+    int64_t last_ms = 0;
+    BitWriter bits;
+
+private:
+    int64_t last_delta = 0;
+    XorState columns[kValueCount];
+};
+
+inline bool decode_block(const RecordHeader& record, const uint8_t* payload, std::vector<Point>& out) {
+    BitReader in(payload, record.size);
+    XorState columns[kValueCount];
+    int64_t timestamp = record.first_ms;
+    int64_t delta = 0;
+    for (uint32_t n = 0; n < record.count; ++n) {
+        double values[kValueCount];
+        if (n == 0) {
+            for (int i = 0; i < kValueCount; ++i) {
+                uint64_t raw;
+                if (!in.read(64, raw)) {
+                    return false;
+                }
+                columns[i].previous = raw;
+                values[i] = from_bits(raw);
+            }
+        } else {
+            int64_t dod;
+            if (!decode_dod(in, dod)) {
+                return false;
+            }
+            delta += dod;
+            timestamp += delta;
+            for (int i = 0; i < kValueCount; ++i) {
+                if (!decode_value(in, columns[i], values[i])) {
+                    return false;
+                }
+            }
+        }
+        out.push_back({timestamp, values[0], values[1], values[2]});
+    }
+    return true;
+}
+
+inline std::string day_file(const std::string& dir, int64_t timestamp_ms) {
+    std::time_t seconds = timestamp_ms / 1000;
+    std::tm local;
+    localtime_r(&seconds, &local);
+    char name[16];
+    std::strftime(name, sizeof(name), "%Y%m%d", &local);
+    return dir + "/" + name + ".fts";
+}
+
+// Writer used by check_fps. Not thread safe; fed from the tick thread only.
+class Store {
+public:
+    explicit Store(const std::string& dir) : dir(dir) {}
+
+    ~Store() { close(); }
+
+    // Creates the directory if needed; false if it cannot be written to
+    bool prepare() {
+        if (::mkdir(dir.c_str(), 0755) != 0 && errno != EEXIST) {
+            std::cerr << "Could not create time-series directory " << dir << ": " << std::strerror(errno) << std::endl;
+            return false;
+        }
+        if (::access(dir.c_str(), W_OK | X_OK) != 0) {
+            std::cerr << "Cannot write to time-series directory " << dir << ": " << std::strerror(errno) << std::endl;
+            return false;
+        }
+        return true;
+    }
+
+    void append(const MetricsSnapshot& snapshot) {
+        std::string path = day_file(dir, snapshot.timestamp_ms);
+        if (path != current_path) {
+            close();
+            // A file that failed once is not retried every tick
+            if (path == failed_path) {
+                return;
+            }
+            if (!open(path)) {
+                failed_path = path;
+                std::cerr << "Time-series writes paused until the next day file" << std::endl;
+                return;
+            }
+        }
+
+        for (const auto& camera : snapshot.cameras) {
+            auto it = series.find(camera.name);
+            if (it == series.end()) {
+                it = series.emplace(camera.name, Series{next_camera_id++, {}}).first;
+                write_record({kCameraRecord, it->second.id, static_cast<uint32_t>(camera.name.size()), 0, 0, 0},
+                             camera.name.data());
+            }
+            Series& s = it->second;
+            if (!s.block.accepts(snapshot.timestamp_ms)) {
+                flush(s);
+            }
+            // Quantise to values with short mantissas, otherwise the XOR
+            // encoding degrades to ~8 bytes per noisy value
+            s.block.append({snapshot.timestamp_ms, camera.fps, std::round(camera.bitrate_kbps),
+                            std::round(camera.jitter_ms * 8) / 8});
+        }
+    }
+
+    void close() {
+        if (!header) {
+            return;
+        }
+        for (auto& entry : series) {
+            flush(entry.second);
+        }
+        if (header) {
+            release();
+        }
+    }
+
+private:
+    struct Series {
+        uint32_t id;
+        BlockEncoder block;
+    };
+
+    // Keeps the committed data, trims the preallocated tail and closes the file
+    void release() {
+        uint64_t committed = header->committed.load(std::memory_order_relaxed);
+        msync(header, committed, MS_SYNC);
+        munmap(header, mapped);
+        // Drop the preallocated tail so the file size matches its contents
+        if (ftruncate(fd, committed) != 0) {
+            std::cerr << "Failed to trim time-series file: " << current_path << std::endl;
+        }
+        ::close(fd);
+        fd = -1;
+        header = nullptr;
+        current_path.clear();
+    }
+
+    bool open(const std::string& path) {
+        series.clear();
+        next_camera_id = 0;
+        fd = ::open(path.c_str(), O_RDWR | O_CREAT, 0644);
+        if (fd < 0) {
+            std::cerr << "Could not open time-series file: " << path << std::endl;
+            return false;
+        }
+        struct stat st;
+        fstat(fd, &st);
+        // An existing day file is reopened after a restart; camera ids restart
+        // from its catalogue so earlier records stay attributable.
+        bool fresh = static_cast<size_t>(st.st_size) < sizeof(FileHeader);
+        if (!map(fresh ? kGrowBytes : st.st_size + kGrowBytes)) {
+            // Do not leave the file grown by a failed attempt
+            if (ftruncate(fd, st.st_size) != 0) {
+                std::cerr << "Failed to restore time-series file size: " << path << std::endl;
+            }
+            ::close(fd);
+            fd = -1;
+            return false;
+        }
+        if (fresh) {
+            std::memcpy(header->magic, kMagic, sizeof(kMagic));
+            header->version = kVersion;
+            header->created_ms = std::time(nullptr) * 1000LL;
+            header->committed.store(sizeof(FileHeader), std::memory_order_release);
+        } else if (std::memcmp(header->magic, kMagic, sizeof(kMagic)) != 0 || header->version != kVersion) {
+            std::cerr << "Not a time-series file, refusing to append: " << path << std::endl;
+            munmap(header, mapped);
+            header = nullptr;
+            ::close(fd);
+            fd = -1;
+            return false;
+        } else {
+            load_catalogue();
+        }
+        current_path = path;
+        return true;
+    }
+
+    // Growing keeps the old mapping until the new one is in place
+    bool map(size_t size) {
+        if (ftruncate(fd, size) != 0) {
+            std::cerr << "Failed to grow time-series file" << std::endl;
+            return false;
+        }
+        void* addr = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        if (addr == MAP_FAILED) {
+            std::cerr << "Failed to map time-series file" << std::endl;
+            return false;
+        }
+        if (header) {
+            munmap(header, mapped);
+        }
+        header = static_cast<FileHeader*>(addr);
+        mapped = size;
+        return true;
+    }
+
+    void load_catalogue() {
+        const uint8_t* base = reinterpret_cast<const uint8_t*>(header);
+        uint64_t end = header->committed.load(std::memory_order_acquire);
+        for (uint64_t offset = sizeof(FileHeader); offset + sizeof(RecordHeader) <= end;) {
+            RecordHeader record;
+            std::memcpy(&record, base + offset, sizeof(record));
+            if (offset + sizeof(record) + record.size > end) {
+                break;
+            }
+            if (record.type == kCameraRecord) {
+                std::string name(reinterpret_cast<const char*>(base + offset + sizeof(record)), record.size);
+                series.emplace(name, Series{record.camera_id, {}});
+                if (record.camera_id >= next_camera_id) {
+                    next_camera_id = record.camera_id + 1;
+                }
+            }
+            offset += sizeof(record) + record.size;
+        }
+    }
+
+    void flush(Series& s) {
+        if (s.block.count == 0) {
+            return;
+        }
+        const auto& bytes = s.block.bits.data();
+        write_record({kBlockRecord, s.id, static_cast<uint32_t>(bytes.size()), s.block.count, s.block.first_ms,
+                      s.block.last_ms},
+                     bytes.data());
+        s.block.reset();
+    }
+
+    void write_record(const RecordHeader& record, const void* payload) {
+        if (!header) {
+            return;
+        }
+        uint64_t offset = header->committed.load(std::memory_order_relaxed);
+        size_t needed = offset + sizeof(record) + record.size;
+        if (needed > mapped && !map(needed + kGrowBytes)) {
+            // Stop writing to this day file rather than drop points silently
+            failed_path = current_path;
+            release();
+            std::cerr << "Time-series writes paused until the next day file" << std::endl;
+            return;
+        }
+        uint8_t* base = reinterpret_cast<uint8_t*>(header);
+        std::memcpy(base + offset, &record, sizeof(record));
+        std::memcpy(base + offset + sizeof(record), payload, record.size);
+        header->committed.store(needed, std::memory_order_release);
+    }
+
+    std::string dir;
+    std::string current_path;
+    std::string failed_path;  // Day file that could not be opened or grown
+    int fd = -1;
+    FileHeader* header = nullptr;
+    size_t mapped = 0;
+    std::map<std::string, Series> series;
+    uint32_t next_camera_id = 0;
+};
+
+// Read-only view of one day file, used by the report tool.
+class FileReader {
+public:
+    ~FileReader() {
+        if (base) {
+            munmap(const_cast<uint8_t*>(base), size);
+        }
+    }
+
+    bool open(const std::string& path) {
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0) {
+            return false;
+        }
+        struct stat st;
+        if (fstat(fd, &st) != 0 || static_cast<size_t>(st.st_size) < sizeof(FileHeader)) {
+            ::close(fd);
+            return false;
+        }
+        size = st.st_size;
+        void* addr = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+        ::close(fd);
+        if (addr == MAP_FAILED) {
+            return false;
+        }
+        base = static_cast<const uint8_t*>(addr);
+        const FileHeader* header = reinterpret_cast<const FileHeader*>(base);
+        if (std::memcmp(header->magic, kMagic, sizeof(kMagic)) != 0 || header->version != kVersion) {
+            std::cerr << "Not a time-series file: " << path << std::endl;
+            return false;
+        }
+        end = header->committed.load(std::memory_order_acquire);
+        if (end > size) {
+            end = size;
+        }
+        return true;
+    }
+
+    // Calls on_camera(id, name) and on_block(record, payload) for every record in file order.
+    template <typename CameraFn, typename BlockFn>
+    void scan(CameraFn on_camera, BlockFn on_block) const {
+        for (uint64_t offset = sizeof(FileHeader); offset + sizeof(RecordHeader) <= end;) {
+            RecordHeader record;
+            std::memcpy(&record, base + offset, sizeof(record));
+            const uint8_t* payload = base + offset + sizeof(record);
+            if (offset + sizeof(record) + record.size > end) {
+                break;
+            }
+            if (record.type == kCameraRecord) {
+                on_camera(record.camera_id, std::string(reinterpret_cast<const char*>(payload), record.size));
+            } else if (record.type == kBlockRecord) {
+                on_block(record, payload);
+            }
+            offset += sizeof(record) + record.size;
+        }
+    }
+
+private:
+    const uint8_t* base = nullptr;
+    size_t size = 0;
+    uint64_t end = 0;
+};
+
+} // namespace tsdb